@@ -0,0 +1,193 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <learnopengl/model.h>
+#include <learnopengl/thread_pool.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Loads several models at once. Mesh import (cache or ASSIMP) and image decoding run on a
+// thread pool, images already in the TextureRegistry are not decoded again; only the GL uploads (textures and Mesh::setupMesh) happen on the thread that
+// calls Finish, which must own the GL context. Uploads are done as soon as their jobs complete.
+//
+//     AssetLoader loader;
+//     loader.Load(village, "resources/objects/village/VolgarStreet.obj");
+//     loader.Load(nissan, "resources/objects/nissan/source/SA5HLA5LO5H1RQJ42KKT685IS.obj");
+//     ... compile shaders etc. while the workers run ...
+//     loader.Finish();
+class AssetLoader {
+public:
+    explicit AssetLoader(unsigned int threadCount = 0) : pool(threadCount)
+    {
+    }
+
+    // starts loading path into model, which has to be empty. model must stay alive until Finish returns.
+    void Load(Model &model, string const &path)
+    {
+        unique_ptr<PendingModel> pending(new PendingModel());
+        pending->model = &model;
+        pending->path = path;
+        model.directory = Model::DirectoryOf(path);
+
+        size_t index = models.size();
+        PendingModel *target = pending.get();
+        models.push_back(std::move(pending));
+        pool.submit([this, target, index] {
+            string error;
+            try
+            {
+                target->loaded = Model::LoadModelData(target->path, target->data, true, true, target->model->clusterTriangles);
+            }
+            catch (const exception &e)
+            {
+                error = e.what();
+            }
+            catch (...)
+            {
+                error = "unknown exception";
+            }
+            notify(Completion{index, -1, error});
+        });
+    }
+
+    // waits for every queued model and performs the GL uploads on the calling thread
+    void Finish()
+    {
+        size_t remaining = models.size();
+        while (remaining > 0)
+        {
+            Completion completion = wait();
+            PendingModel &pending = *models[completion.model];
+            if (!completion.error.empty())
+            {
+                cout << "ERROR::ASSET_LOADER:: " << pending.path;
+                if (completion.texture >= 0)
+                    cout << ": " << pending.data.textures[completion.texture].path;
+                cout << ": " << completion.error << endl;
+                pending.failed = true;
+            }
+
+            if (completion.texture < 0)
+            {
+                // model data is in, decode all of its textures in parallel
+                if (!pending.loaded || pending.failed)
+                {
+                    remaining--;
+                    continue;
+                }
+                pending.images.resize(pending.data.textures.size());
+                pending.model->textures_loaded.resize(pending.images.size());
+                pending.texturesLeft = pending.images.size();
+                for (size_t i = 0; i < pending.images.size(); i++)
+                {
+                    size_t model = completion.model;
+                    int texture = i;
+                    PendingModel *target = &pending;
+                    pool.submit([this, target, model, texture] {
+                        string error;
+                        try
+                        {
+                            string filename = target->model->directory + '/' + target->data.textures[texture].path;
+                            target->images[texture] = TextureRegistry::Instance().Prepare(filename);
+                        }
+                        catch (const exception &e)
+                        {
+                            error = e.what();
+                        }
+                        catch (...)
+                        {
+                            error = "unknown exception";
+                        }
+                        notify(Completion{model, texture, error});
+                    });
+                }
+            }
+            else
+            {
+                // uploaded even for a failed model, so ReleaseTextures frees the decoded pixels
+                if (completion.error.empty())
+                    uploadTexture(pending, completion.texture);
+                pending.texturesLeft--;
+            }
+
+            // meshes go up once all of their textures are resident. A model with a failed job is
+            // left empty, as if it had not loaded, once the last of its jobs is back.
+            if (pending.loaded && pending.texturesLeft == 0)
+            {
+                if (pending.failed)
+                    pending.model->ReleaseTextures();
+                else
+                    pending.model->SetupMeshes(pending.data);
+                pending.images.clear();
+                pending.data = ModelData();
+                remaining--;
+            }
+        }
+        models.clear();
+    }
+
+private:
+    struct PendingModel {
+        Model *model = nullptr;
+        string path;
+        bool loaded = false;
+        bool failed = false; // a job threw, see Completion::error
+        ModelData data;
+        vector<TextureSource> images;
+        size_t texturesLeft = 0;
+    };
+
+    // a finished job: model data when texture < 0, otherwise the decoded image of that texture.
+    // error holds what the job threw, empty if it succeeded.
+    struct Completion {
+        size_t model;
+        int texture;
+        string error;
+    };
+
+    vector<unique_ptr<PendingModel>> models;
+    deque<Completion> completed;
+    mutex completedMutex;
+    condition_variable completedCondition;
+    // declared last so the workers are joined before the state they use is destroyed
+    ThreadPool pool;
+
+    void notify(Completion completion)
+    {
+        {
+            lock_guard<mutex> lock(completedMutex);
+            completed.push_back(completion);
+        }
+        completedCondition.notify_one();
+    }
+
+    Completion wait()
+    {
+        unique_lock<mutex> lock(completedMutex);
+        completedCondition.wait(lock, [this] { return !completed.empty(); });
+        Completion completion = completed.front();
+        completed.pop_front();
+        return completion;
+    }
+
+    void uploadTexture(PendingModel &pending, int index)
+    {
+        Model &model = *pending.model;
+        const TextureRef &ref = pending.data.textures[index];
+        Texture &texture = model.textures_loaded[index];
+        texture.id = TextureRegistry::Instance().Acquire(pending.images[index], model.gammaCorrection);
+        texture.constant = pending.images[index].isConstant;
+        texture.color = pending.images[index].color;
+        texture.type = ref.type;
+        texture.path = ref.path;
+    }
+};
+#endif
@@ -0,0 +1,238 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BOUNDS_SSE 1
+#endif
+
+// Axis aligned box and bounding sphere of a mesh, in model space as computed at load time or in
+// world space after Transformed. The sphere is centered on the box, with the radius reaching the
+// farthest vertex, which is tighter than the half diagonal for most meshes.
+struct MeshBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float radius;
+
+    // bounds of the Position member of every vertex, all zero for an empty mesh
+    template <typename V>
+    static MeshBounds FromVertices(const vector<V> &vertices)
+    {
+        MeshBounds bounds;
+        bounds.min = bounds.max = bounds.center = glm::vec3(0.0f);
+        bounds.radius = 0.0f;
+        if (vertices.empty())
+            return bounds;
+
+        bounds.min = bounds.max = vertices[0].Position;
+        for (const V &vertex : vertices)
+        {
+            bounds.min = glm::min(bounds.min, vertex.Position);
+            bounds.max = glm::max(bounds.max, vertex.Position);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        float radius2 = 0.0f;
+        for (const V &vertex : vertices)
+        {
+            glm::vec3 offset = vertex.Position - bounds.center;
+            radius2 = std::max(radius2, glm::dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radius2);
+        return bounds;
+    }
+
+    // bounds after the affine transform m. The box is refitted from the transformed center and the
+    // absolute matrix applied to the half extents (Arvo), the radius grows with the largest axis scale.
+    MeshBounds Transformed(const glm::mat4 &m) const
+    {
+        glm::vec3 boxCenter = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+        glm::vec3 worldCenter = glm::vec3(m * glm::vec4(boxCenter, 1.0f));
+        glm::vec3 worldExtent;
+        for (int row = 0; row < 3; row++)
+            worldExtent[row] = std::fabs(m[0][row]) * extent.x + std::fabs(m[1][row]) * extent.y
+                               + std::fabs(m[2][row]) * extent.z;
+
+        float scale2 = 0.0f;
+        for (int column = 0; column < 3; column++)
+            scale2 = std::max(scale2, glm::dot(glm::vec3(m[column]), glm::vec3(m[column])));
+
+        MeshBounds result;
+        result.min = worldCenter - worldExtent;
+        result.max = worldCenter + worldExtent;
+        result.center = glm::vec3(m * glm::vec4(center, 1.0f));
+        result.radius = radius * std::sqrt(scale2);
+        return result;
+    }
+};
+
+// The six planes of a view frustum, extracted from projection * view (Gribb/Hartmann) and
+// normalized, so a*x + b*y + c*z + d is the signed distance of a world space point, positive
+// inside. Stored as structure of arrays padded to eight planes that accept everything, so the
+// tests below take four planes or four objects per SSE instruction.
+struct Frustum {
+    static const int PLANES = 6;
+    static const int PADDED_PLANES = 8;
+
+    float a[PADDED_PLANES], b[PADDED_PLANES], c[PADDED_PLANES], d[PADDED_PLANES];
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        // glm is column major, so row i of the matrix is m[0][i], m[1][i], m[2][i], m[3][i]
+        for (int i = 0; i < PLANES; i++)
+        {
+            int row = i / 2;
+            float sign = i % 2 == 0 ? 1.0f : -1.0f; // left/right, bottom/top, near/far
+            glm::vec4 plane;
+            for (int column = 0; column < 4; column++)
+                plane[column] = viewProjection[column][3] + sign * viewProjection[column][row];
+            float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            a[i] = plane.x / length;
+            b[i] = plane.y / length;
+            c[i] = plane.z / length;
+            d[i] = plane.w / length;
+        }
+        for (int i = PLANES; i < PADDED_PLANES; i++)
+        {
+            a[i] = b[i] = c[i] = 0.0f;
+            d[i] = 1.0f;
+        }
+    }
+};
+
+// World space bounds of many objects as structure of arrays, the layout the SIMD tests load from.
+// Objects are static here, so the array is filled once and only tested every frame.
+class BoundsArray {
+public:
+    void Clear()
+    {
+        sphereX.clear(); sphereY.clear(); sphereZ.clear(); sphereRadius.clear();
+        boxX.clear(); boxY.clear(); boxZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+
+    void Add(const MeshBounds &world)
+    {
+        glm::vec3 boxCenter = (world.min + world.max) * 0.5f;
+        glm::vec3 extent = (world.max - world.min) * 0.5f;
+        sphereX.push_back(world.center.x);
+        sphereY.push_back(world.center.y);
+        sphereZ.push_back(world.center.z);
+        sphereRadius.push_back(world.radius);
+        boxX.push_back(boxCenter.x);
+        boxY.push_back(boxCenter.y);
+        boxZ.push_back(boxCenter.z);
+        extentX.push_back(extent.x);
+        extentY.push_back(extent.y);
+        extentZ.push_back(extent.z);
+    }
+
+    size_t Size() const
+    {
+        return sphereRadius.size();
+    }
+
+    // Sets visible[i] for every object intersecting frustum and returns how many do. Spheres
+    // are tested first, four objects at a time; objects whose sphere crosses a plane get the
+    // tighter box test, four planes at a time.
+    size_t Cull(const Frustum &frustum, vector<unsigned char> &visible) const
+    {
+        size_t count = Size();
+        visible.resize(count);
+        size_t visibleCount = 0;
+        size_t i = 0;
+#ifdef BOUNDS_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&sphereX[i]);
+            __m128 y = _mm_loadu_ps(&sphereY[i]);
+            __m128 z = _mm_loadu_ps(&sphereZ[i]);
+            __m128 r = _mm_loadu_ps(&sphereRadius[i]);
+            __m128 negativeR = _mm_sub_ps(_mm_setzero_ps(), r);
+            __m128 outside = _mm_setzero_ps();
+            __m128 crossing = _mm_setzero_ps();
+            for (int p = 0; p < Frustum::PLANES; p++)
+            {
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(frustum.a[p])), _mm_mul_ps(y, _mm_set1_ps(frustum.b[p]))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(frustum.c[p])), _mm_set1_ps(frustum.d[p])));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeR));
+                crossing = _mm_or_ps(crossing, _mm_cmplt_ps(distance, r));
+            }
+            int outsideMask = _mm_movemask_ps(outside);
+            int crossingMask = _mm_movemask_ps(crossing);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                bool inside = !(outsideMask & (1 << lane))
+                              && (!(crossingMask & (1 << lane)) || !boxOutside(frustum, i + lane));
+                visible[i + lane] = inside;
+                visibleCount += inside;
+            }
+        }
+#endif
+        for (; i < count; i++)
+        {
+            bool inside = !sphereOutside(frustum, i) && !boxOutside(frustum, i);
+            visible[i] = inside;
+            visibleCount += inside;
+        }
+        return visibleCount;
+    }
+
+private:
+    vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+    vector<float> boxX, boxY, boxZ;
+    vector<float> extentX, extentY, extentZ;
+
+    bool sphereOutside(const Frustum &frustum, size_t i) const
+    {
+        for (int p = 0; p < Frustum::PLANES; p++)
+            if (frustum.a[p] * sphereX[i] + frustum.b[p] * sphereY[i] + frustum.c[p] * sphereZ[i] + frustum.d[p]
+                < -sphereRadius[i])
+                return true;
+        return false;
+    }
+
+    // the box is outside when its center lies farther behind a plane than the box reaches
+    // towards it: |a| * ex + |b| * ey + |c| * ez
+    bool boxOutside(const Frustum &frustum, size_t i) const
+    {
+#ifdef BOUNDS_SSE
+        __m128 signMask = _mm_set1_ps(-0.0f);
+        __m128 x = _mm_set1_ps(boxX[i]), y = _mm_set1_ps(boxY[i]), z = _mm_set1_ps(boxZ[i]);
+        __m128 ex = _mm_set1_ps(extentX[i]), ey = _mm_set1_ps(extentY[i]), ez = _mm_set1_ps(extentZ[i]);
+        for (int p = 0; p < Frustum::PADDED_PLANES; p += 4)
+        {
+            __m128 a = _mm_loadu_ps(&frustum.a[p]), b = _mm_loadu_ps(&frustum.b[p]), c = _mm_loadu_ps(&frustum.c[p]);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)),
+                                         _mm_add_ps(_mm_mul_ps(c, z), _mm_loadu_ps(&frustum.d[p])));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, a), ex),
+                                                 _mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+                                      _mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps())))
+                return true;
+        }
+        return false;
+#else
+        for (int p = 0; p < Frustum::PLANES; p++)
+        {
+            float distance = frustum.a[p] * boxX[i] + frustum.b[p] * boxY[i] + frustum.c[p] * boxZ[i] + frustum.d[p];
+            float reach = std::fabs(frustum.a[p]) * extentX[i] + std::fabs(frustum.b[p]) * extentY[i]
+                          + std::fabs(frustum.c[p]) * extentZ[i];
+            if (distance + reach < 0.0f)
+                return true;
+        }
+        return false;
+#endif
+    }
+};
+#endif
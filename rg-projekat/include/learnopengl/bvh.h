@@ -0,0 +1,384 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+using namespace std;
+
+// one node of a flattened Bvh, 32 bytes so two share a cache line. Nodes are stored depth first:
+// the first child of an inner node is the node right after it, the second one is at first.
+struct BvhNode {
+    glm::vec3 min;
+    uint32_t first; // leaf: first entry in Bvh::primitives, inner node: index of the second child
+    glm::vec3 max;
+    uint32_t count; // primitives in a leaf, 0 for inner nodes
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode layout");
+
+// Bounding volume hierarchy over axis aligned boxes, built top down with the surface area
+// heuristic: every node is split where SAH_BINS centroid bins along one of the three axes give
+// the lowest sum of child area times primitive count. Nodes with at most maxLeafSize primitives
+// become leaves, so the same builder makes small leaves for culling and large ones for
+// MeshClusterer.
+//
+// Primitives are referenced by their index in the boxes passed to Build. The hierarchy holds no
+// pointers, only the node array and the primitive order of its leaves, so it can be kept,
+// copied or traversed from several threads.
+class Bvh {
+public:
+    static const int SAH_BINS = 12;
+    // nodes at this depth become leaves whatever their size, which bounds the traversal stacks.
+    // SAH splits always separate some primitives, so only degenerate input gets near it.
+    static const unsigned int MAX_DEPTH = 60;
+
+    vector<BvhNode> nodes;
+    vector<uint32_t> primitives;     // primitive indices, every leaf owns a contiguous range
+    vector<glm::vec3> primitiveMin;  // boxes of the primitives, in the order of primitives
+    vector<glm::vec3> primitiveMax;
+
+    void Build(const vector<MeshBounds> &boxes, unsigned int maxLeafSize)
+    {
+        nodes.clear();
+        primitives.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++)
+            primitives[i] = i;
+        if (boxes.empty())
+            return;
+        centroids.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++)
+            centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        nodes.reserve(2 * boxes.size() / std::max(maxLeafSize, 1u) + 1);
+        build(boxes, 0, boxes.size(), std::max(maxLeafSize, 1u), 1);
+        vector<glm::vec3>().swap(centroids);
+
+        primitiveMin.resize(boxes.size());
+        primitiveMax.resize(boxes.size());
+        for (size_t i = 0; i < primitives.size(); i++)
+        {
+            primitiveMin[i] = boxes[primitives[i]].min;
+            primitiveMax[i] = boxes[primitives[i]].max;
+        }
+    }
+
+    size_t PrimitiveCount() const
+    {
+        return primitives.size();
+    }
+
+    // Sets visible[i] for every primitive whose box intersects frustum and returns how many do.
+    // Nodes outside a plane are skipped with their subtree; planes a node lies inside are not
+    // tested again below it, so subtrees inside the frustum are accepted without any test.
+    size_t Cull(const Frustum &frustum, vector<unsigned char> &visible, size_t *nodesVisited = nullptr) const
+    {
+        visible.assign(primitives.size(), 0);
+        if (nodes.empty())
+            return 0;
+        size_t visibleCount = 0, visited = 0;
+        struct Entry { uint32_t node; uint32_t planes; };
+        // one pending sibling per level above plus two children: at most d + 1 entries below an inner
+        // node of depth d, and inner nodes are shallower than MAX_DEPTH
+        Entry stack[MAX_DEPTH + 1];
+        int top = 0;
+        stack[top++] = Entry{0, (1u << Frustum::PLANES) - 1};
+        while (top > 0)
+        {
+            Entry entry = stack[--top];
+            const BvhNode &node = nodes[entry.node];
+            visited++;
+            uint32_t planes = entry.planes;
+            if (planes && !testBox(frustum, node.min, node.max, planes))
+                continue;
+            if (node.count == 0)
+            {
+                stack[top++] = Entry{node.first, planes};
+                stack[top++] = Entry{entry.node + 1, planes};
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                uint32_t primitivePlanes = planes;
+                if (primitivePlanes && !testBox(frustum, primitiveMin[i], primitiveMax[i], primitivePlanes))
+                    continue;
+                visible[primitives[i]] = 1;
+                visibleCount++;
+            }
+        }
+        if (nodesVisited)
+            *nodesVisited += visited;
+        return visibleCount;
+    }
+
+    // Nearest hit along a ray. hit(primitive, entry) is called for every primitive whose box the
+    // ray enters before the nearest hit so far, entry being the distance to its box, and returns
+    // the distance of its own hit or a negative value for a miss. Children are visited nearest
+    // first. Returns the primitive hit (distance receives how far) or -1.
+    template <typename Hit>
+    int Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance, Hit hit) const
+    {
+        if (nodes.empty())
+            return -1;
+        glm::vec3 inverse;
+        for (int axis = 0; axis < 3; axis++)
+            inverse[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : std::numeric_limits<float>::infinity();
+        int result = -1;
+        uint32_t stack[MAX_DEPTH + 1];
+        int top = 0;
+        float entry;
+        if (!rayBox(origin, inverse, nodes[0].min, nodes[0].max, distance, entry))
+            return -1;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BvhNode &node = nodes[stack[--top]];
+            if (!rayBox(origin, inverse, node.min, node.max, distance, entry))
+                continue;
+            if (node.count == 0)
+            {
+                uint32_t nearChild = &node - nodes.data() + 1, farChild = node.first;
+                float nearEntry, farEntry;
+                bool nearHit = rayBox(origin, inverse, nodes[nearChild].min, nodes[nearChild].max, distance, nearEntry);
+                bool farHit = rayBox(origin, inverse, nodes[farChild].min, nodes[farChild].max, distance, farEntry);
+                if (nearHit && farHit && farEntry < nearEntry)
+                    std::swap(nearChild, farChild);
+                else if (!nearHit)
+                {
+                    nearChild = farChild;
+                    nearHit = farHit;
+                    farHit = false;
+                }
+                // the nearer child goes on top of the stack
+                if (farHit)
+                    stack[top++] = farChild;
+                if (nearHit)
+                    stack[top++] = nearChild;
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                if (!rayBox(origin, inverse, primitiveMin[i], primitiveMax[i], distance, entry))
+                    continue;
+                float t = hit(primitives[i], entry);
+                if (t >= 0.0f && t < distance)
+                {
+                    distance = t;
+                    result = primitives[i];
+                }
+            }
+        }
+        return result;
+    }
+
+    // depth of the deepest leaf, the root being 1
+    unsigned int Depth() const
+    {
+        return nodes.empty() ? 0 : depth(0);
+    }
+
+private:
+    vector<glm::vec3> centroids; // of every primitive, only while building
+
+    struct Bin {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+        unsigned int count = 0;
+
+        void grow(const glm::vec3 &lo, const glm::vec3 &hi)
+        {
+            min = glm::min(min, lo);
+            max = glm::max(max, hi);
+        }
+
+        void grow(const Bin &o)
+        {
+            min = glm::min(min, o.min);
+            max = glm::max(max, o.max);
+            count += o.count;
+        }
+
+        float area() const
+        {
+            if (count == 0)
+                return 0.0f;
+            glm::vec3 e = max - min;
+            return e.x * e.y + e.y * e.z + e.z * e.x;
+        }
+    };
+
+    // builds the subtree of primitives[first, last), returns its node index
+    uint32_t build(const vector<MeshBounds> &boxes, uint32_t first, uint32_t last, unsigned int maxLeafSize,
+                   unsigned int level)
+    {
+        uint32_t index = nodes.size();
+        nodes.push_back(BvhNode());
+        BvhNode node;
+        node.min = glm::vec3(std::numeric_limits<float>::max());
+        node.max = glm::vec3(-std::numeric_limits<float>::max());
+        glm::vec3 centroidMin = node.min, centroidMax = node.max;
+        for (uint32_t i = first; i < last; i++)
+        {
+            const MeshBounds &box = boxes[primitives[i]];
+            node.min = glm::min(node.min, box.min);
+            node.max = glm::max(node.max, box.max);
+            centroidMin = glm::min(centroidMin, centroids[primitives[i]]);
+            centroidMax = glm::max(centroidMax, centroids[primitives[i]]);
+        }
+
+        uint32_t count = last - first;
+        if (count <= maxLeafSize || level >= MAX_DEPTH)
+        {
+            node.first = first;
+            node.count = count;
+            nodes[index] = node;
+            return index;
+        }
+
+        uint32_t middle = splitSah(boxes, first, last, centroidMin, centroidMax);
+        if (middle == first || middle == last)
+        {
+            // all centroids in one bin, any split is as good as another
+            middle = first + count / 2;
+            std::nth_element(primitives.begin() + first, primitives.begin() + middle, primitives.begin() + last,
+                             [&](uint32_t a, uint32_t b) { return centroids[a].x < centroids[b].x; });
+        }
+        build(boxes, first, middle, maxLeafSize, level + 1);
+        node.first = build(boxes, middle, last, maxLeafSize, level + 1);
+        node.count = 0;
+        nodes[index] = node;
+        return index;
+    }
+
+    // partitions primitives[first, last) at the cheapest binned SAH split, returns where the
+    // second half starts
+    uint32_t splitSah(const vector<MeshBounds> &boxes, uint32_t first, uint32_t last, const glm::vec3 &centroidMin,
+                      const glm::vec3 &centroidMax)
+    {
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+            Bin bins[SAH_BINS];
+            float scale = SAH_BINS / extent;
+            for (uint32_t i = first; i < last; i++)
+            {
+                const MeshBounds &box = boxes[primitives[i]];
+                Bin &bin = bins[binOf(centroids[primitives[i]][axis], centroidMin[axis], scale)];
+                bin.grow(box.min, box.max);
+                bin.count++;
+            }
+            // cost of splitting after bin s: area and count of everything left of it, and right
+            float leftCost[SAH_BINS - 1];
+            Bin left, right;
+            for (int s = 0; s < SAH_BINS - 1; s++)
+            {
+                left.grow(bins[s]);
+                leftCost[s] = left.area() * left.count;
+            }
+            for (int s = SAH_BINS - 1; s > 0; s--)
+            {
+                right.grow(bins[s]);
+                float cost = leftCost[s - 1] + right.area() * right.count;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = s;
+                }
+            }
+        }
+        if (bestAxis < 0)
+            return first;
+
+        float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        uint32_t *middle = std::partition(primitives.data() + first, primitives.data() + last, [&](uint32_t p) {
+            return binOf(centroids[p][bestAxis], centroidMin[bestAxis], scale) < bestSplit;
+        });
+        return middle - primitives.data();
+    }
+
+    static int binOf(float centroid, float min, float scale)
+    {
+        return std::min((int)((centroid - min) * scale), SAH_BINS - 1);
+    }
+
+    // false if the box lies outside one of the planes; clears the bits of the planes it lies
+    // completely inside of
+    static bool testBox(const Frustum &frustum, const glm::vec3 &min, const glm::vec3 &max, uint32_t &planes)
+    {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+#ifdef BOUNDS_SSE
+        // four planes at a time, like BoundsArray::boxOutside
+        __m128 signMask = _mm_set1_ps(-0.0f);
+        __m128 x = _mm_set1_ps(center.x), y = _mm_set1_ps(center.y), z = _mm_set1_ps(center.z);
+        __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+        for (int p = 0; p < Frustum::PADDED_PLANES; p += 4)
+        {
+            __m128 a = _mm_loadu_ps(&frustum.a[p]), b = _mm_loadu_ps(&frustum.b[p]), c = _mm_loadu_ps(&frustum.c[p]);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)),
+                                         _mm_add_ps(_mm_mul_ps(c, z), _mm_loadu_ps(&frustum.d[p])));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, a), ex),
+                                                 _mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+                                      _mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+            uint32_t outside = _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps())) << p;
+            if (outside & planes)
+                return false;
+            uint32_t inside = _mm_movemask_ps(_mm_cmpge_ps(_mm_sub_ps(distance, reach), _mm_setzero_ps())) << p;
+            planes &= ~inside;
+        }
+        return true;
+#else
+        for (int p = 0; p < Frustum::PLANES; p++)
+        {
+            if (!(planes & (1u << p)))
+                continue;
+            float distance = frustum.a[p] * center.x + frustum.b[p] * center.y + frustum.c[p] * center.z + frustum.d[p];
+            float reach = std::fabs(frustum.a[p]) * extent.x + std::fabs(frustum.b[p]) * extent.y
+                          + std::fabs(frustum.c[p]) * extent.z;
+            if (distance + reach < 0.0f)
+                return false;
+            if (distance - reach >= 0.0f)
+                planes &= ~(1u << p);
+        }
+        return true;
+#endif
+    }
+
+    // slab test, entry receives where the ray enters the box (0 if it starts inside)
+    static bool rayBox(const glm::vec3 &origin, const glm::vec3 &inverse, const glm::vec3 &min, const glm::vec3 &max,
+                       float maxDistance, float &entry)
+    {
+        float tNear = 0.0f, tFar = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (max[axis] - origin[axis]) * inverse[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            // NaN (origin on a slab of a flat box, direction 0) keeps the previous bounds
+            tNear = t0 > tNear ? t0 : tNear;
+            tFar = t1 < tFar ? t1 : tFar;
+        }
+        entry = tNear;
+        return tNear <= tFar;
+    }
+
+    unsigned int depth(uint32_t index) const
+    {
+        const BvhNode &node = nodes[index];
+        if (node.count > 0)
+            return 1;
+        return 1 + std::max(depth(index + 1), depth(node.first));
+    }
+};
+#endif
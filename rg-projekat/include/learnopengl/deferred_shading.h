@@ -0,0 +1,269 @@
+#ifndef DEFERRED_SHADING_H
+#define DEFERRED_SHADING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/frame_uniforms.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+using namespace std;
+
+// one point or spot light of the lighting pass, the per instance attributes of deferred_point.vs
+struct LightVolume {
+    glm::vec4 sphere; // position, radius
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    // a spot light's direction and the cosine of its inner cutoff, and the cosine of its outer
+    // cutoff; a point light leaves both zero, equal cutoffs mean no cone
+    glm::vec4 cone = glm::vec4(0.0f);
+    float outerCutOff = 0.0f;
+};
+
+// Deferred shading, the alternative to the scene's forward shaders (see Scene::deferred):
+//
+//   1. Begin binds the G-buffer and the scene draws every visible mesh into it with gbuffer.fs:
+//      diffuse texel, world space normal and specular texel in three color targets, and a
+//      depth/stencil texture the lighting pass reconstructs positions from
+//   2. Light copies depth and stencil to the default framebuffer, for the skybox and the overdraw
+//      view, and adds up the lights there: the directional light over the whole viewport with
+//      deferred_global.fs, then all point lights and the spotlight in one instanced draw of sphere
+//      volumes, each shading only the pixels in front of its back faces and within its radius
+//      (and a spotlight only those inside its cone).
+//
+// A light then costs the pixels it reaches, not a loop in every fragment of the scene, and the
+// scene may have any number of them. The 1/d^2 falloff of the lights never reaches zero, a
+// volume ends where the light falls below LIGHT_THRESHOLD (see LightRadius).
+class DeferredShading {
+public:
+    static const int SPHERE_SECTORS = 16;
+    static const int SPHERE_RINGS = 8;
+    static constexpr float LIGHT_THRESHOLD = 1.0f / 256.0f; // one step of an 8 bit channel
+
+    // radius of the volume of a point or spot light whose ambient, diffuse and specular add up to intensity
+    static float LightRadius(const glm::vec3 &intensity)
+    {
+        float brightest = std::max(intensity.x, std::max(intensity.y, intensity.z));
+        return std::sqrt(brightest / LIGHT_THRESHOLD);
+    }
+
+    void Create()
+    {
+        globalShader.reset(new Shader("resources/shaders/fullscreen_triangle.vs", "resources/shaders/deferred_global.fs"));
+        pointShader.reset(new Shader("resources/shaders/deferred_point.vs", "resources/shaders/deferred_point.fs"));
+        for (Shader *shader : {globalShader.get(), pointShader.get()})
+        {
+            FrameUniformBuffer::Bind(*shader);
+            shader->use();
+            shader->setInt("gAlbedo", 0);
+            shader->setInt("gNormal", 1);
+            shader->setInt("gSpecular", 2);
+            shader->setInt("gDepth", 3);
+            shader->setFloat("shininess", 32.0f); // as Scene::CreateShaders sets for the forward shaders
+        }
+        globalInverseViewProjection = globalShader->uniform("inverseViewProjection");
+        globalInverseViewportSize = globalShader->uniform("inverseViewportSize");
+        pointInverseViewProjection = pointShader->uniform("inverseViewProjection");
+        pointInverseViewportSize = pointShader->uniform("inverseViewportSize");
+
+        glGenFramebuffers(1, &gBuffer);
+        glGenVertexArrays(1, &emptyVAO);
+        createSphere();
+    }
+
+    void Destroy()
+    {
+        if (!gBuffer)
+            return;
+        globalShader.reset();
+        pointShader.reset();
+        for (unsigned int &texture : textures)
+        {
+            GLState::Get().DeleteTexture(texture);
+            texture = 0;
+        }
+        GLState::Get().DeleteVertexArray(emptyVAO);
+        GLState::Get().DeleteVertexArray(sphereVAO);
+        GLState::Get().DeleteBuffer(sphereVertices);
+        GLState::Get().DeleteBuffer(sphereIndices);
+        GLState::Get().DeleteBuffer(lightBuffer);
+        glDeleteFramebuffers(1, &gBuffer);
+        gBuffer = emptyVAO = sphereVAO = sphereVertices = sphereIndices = lightBuffer = 0;
+        width = height = 0;
+    }
+
+    // the G-buffer, where the geometry pass renders
+    unsigned int Framebuffer() const
+    {
+        return gBuffer;
+    }
+
+    // binds the G-buffer for the geometry pass, width x height being the framebuffer size. Only
+    // depth and stencil are cleared, the lighting pass skips pixels left at the far plane.
+    void Begin(int framebufferWidth, int framebufferHeight)
+    {
+        if (framebufferWidth != width || framebufferHeight != height)
+            resize(framebufferWidth, framebufferHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+
+    // lights the G-buffer into the default framebuffer, whose depth and stencil it overwrites
+    void Light(const vector<LightVolume> &lights, const glm::mat4 &viewProjection)
+    {
+        GLState &state = GLState::Get();
+        FrameStats &stats = FrameStats::Get();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        for (unsigned int unit = 0; unit < TARGETS; unit++)
+            state.BindTexture(unit, GL_TEXTURE_2D, textures[unit]);
+        glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+        glm::vec2 inverseViewportSize(1.0f / width, 1.0f / height);
+
+        // alpha 1 replaces the cleared color through the scene's blending
+        state.Disable(GL_DEPTH_TEST);
+        globalShader->use();
+        globalShader->setMat4(globalInverseViewProjection, inverseViewProjection);
+        globalShader->setVec2(globalInverseViewportSize, inverseViewportSize);
+        state.BindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        stats.drawCalls++;
+        state.Enable(GL_DEPTH_TEST);
+        if (lights.empty())
+            return;
+
+        // back faces passing GL_GEQUAL lie behind the surface, whether the camera is inside the
+        // volume or not; depth clamping keeps volumes reaching past the far plane whole
+        state.BindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+        glBufferData(GL_ARRAY_BUFFER, lights.size() * sizeof(LightVolume), lights.data(), GL_STREAM_DRAW);
+        state.DepthFunc(GL_GEQUAL);
+        state.DepthMask(false);
+        state.CullFace(GL_FRONT);
+        state.Enable(GL_DEPTH_CLAMP);
+        state.BlendFunc(GL_ONE, GL_ONE);
+        pointShader->use();
+        pointShader->setMat4(pointInverseViewProjection, inverseViewProjection);
+        pointShader->setVec2(pointInverseViewportSize, inverseViewportSize);
+        state.BindVertexArray(sphereVAO);
+        glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_SHORT, (void*)0, lights.size());
+        stats.drawCalls++;
+        stats.lightVolumes += lights.size();
+        state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.Disable(GL_DEPTH_CLAMP);
+        state.CullFace(GL_BACK);
+        state.DepthMask(true);
+        state.DepthFunc(GL_LESS);
+    }
+
+private:
+    static const unsigned int TARGETS = 4; // albedo, normal, specular, depth/stencil; also their texture units
+
+    unique_ptr<Shader> globalShader, pointShader;
+    GLint globalInverseViewProjection = -1, globalInverseViewportSize = -1;
+    GLint pointInverseViewProjection = -1, pointInverseViewportSize = -1;
+    unsigned int gBuffer = 0;
+    unsigned int textures[TARGETS] = {0, 0, 0, 0};
+    int width = 0, height = 0;
+    unsigned int emptyVAO = 0;
+    unsigned int sphereVAO = 0, sphereVertices = 0, sphereIndices = 0, lightBuffer = 0;
+    GLsizei sphereIndexCount = 0;
+
+    void resize(int framebufferWidth, int framebufferHeight)
+    {
+        width = framebufferWidth;
+        height = framebufferHeight;
+        // normals need the range and precision of half floats, the texels are 8 bit to begin with
+        const GLenum internalFormats[TARGETS] = {GL_RGBA8, GL_RGBA16F, GL_RGBA8, GL_DEPTH24_STENCIL8};
+        const GLenum formats[TARGETS] = {GL_RGBA, GL_RGBA, GL_RGBA, GL_DEPTH_STENCIL};
+        const GLenum types[TARGETS] = {GL_UNSIGNED_BYTE, GL_HALF_FLOAT, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_24_8};
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        for (unsigned int i = 0; i < TARGETS; i++)
+        {
+            if (!textures[i])
+                glGenTextures(1, &textures[i]);
+            GLState::Get().BindTexture(i, GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, i + 1 < TARGETS ? GL_COLOR_ATTACHMENT0 + i : GL_DEPTH_STENCIL_ATTACHMENT,
+                                   GL_TEXTURE_2D, textures[i], 0);
+        }
+        const GLenum drawBuffers[TARGETS - 1] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(TARGETS - 1, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::DEFERRED_SHADING:: G-buffer not complete" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // a unit UV sphere, counter-clockwise from the outside, pushed out so its flat faces stay
+    // outside the unit sphere; plus the per light attributes, filled by Light
+    void createSphere()
+    {
+        const float pi = 3.14159265f;
+        float scale = 1.0f / (std::cos(pi / SPHERE_SECTORS) * std::cos(pi / (2 * SPHERE_RINGS)));
+        vector<glm::vec3> vertices;
+        for (int ring = 0; ring <= SPHERE_RINGS; ring++)
+        {
+            float theta = pi * ring / SPHERE_RINGS;
+            for (int sector = 0; sector < SPHERE_SECTORS; sector++)
+            {
+                float phi = 2.0f * pi * sector / SPHERE_SECTORS;
+                vertices.push_back(scale * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                                                     std::sin(theta) * std::sin(phi)));
+            }
+        }
+        vector<uint16_t> indices;
+        for (int ring = 0; ring < SPHERE_RINGS; ring++)
+            for (int sector = 0; sector < SPHERE_SECTORS; sector++)
+            {
+                uint16_t a = ring * SPHERE_SECTORS + sector;
+                uint16_t b = ring * SPHERE_SECTORS + (sector + 1) % SPHERE_SECTORS;
+                uint16_t c = a + SPHERE_SECTORS, d = b + SPHERE_SECTORS;
+                indices.insert(indices.end(), {a, b, c, b, d, c});
+            }
+        sphereIndexCount = indices.size();
+
+        GLState &state = GLState::Get();
+        glGenVertexArrays(1, &sphereVAO);
+        glGenBuffers(1, &sphereVertices);
+        glGenBuffers(1, &sphereIndices);
+        glGenBuffers(1, &lightBuffer);
+        state.BindVertexArray(sphereVAO);
+        state.BindBuffer(GL_ARRAY_BUFFER, sphereVertices);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIndices);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+        state.BindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsetof(LightVolume, sphere));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsetof(LightVolume, ambient));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsetof(LightVolume, diffuse));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsetof(LightVolume, specular));
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsetof(LightVolume, cone));
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsetof(LightVolume, outerCutOff));
+        for (GLuint attribute = 1; attribute <= 6; attribute++)
+            glVertexAttribDivisor(attribute, 1);
+        state.BindVertexArray(0);
+    }
+};
+#endif
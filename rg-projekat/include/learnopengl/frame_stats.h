@@ -0,0 +1,101 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <iostream>
+
+// kinds of state changes that go through GLState
+enum StateCall {
+    STATE_PROGRAM,
+    STATE_VERTEX_ARRAY,
+    STATE_ACTIVE_TEXTURE,
+    STATE_TEXTURE,
+    STATE_BUFFER,
+    STATE_CAPABILITY,
+    STATE_DEPTH,
+    STATE_CULL_FACE,
+    STATE_BLEND_FUNC,
+    STATE_COLOR_MASK,
+    STATE_CALL_COUNT
+};
+
+const char *const STATE_CALL_NAMES[STATE_CALL_COUNT] = {
+    "program", "vertex array", "active texture", "texture", "buffer", "enable/disable", "depth", "cull face", "blend func", "color mask"
+};
+
+// counters of the work the renderer hands to the driver, reset at the start of every frame
+struct FrameStats {
+    // shader uniforms
+    unsigned int uniformNameLookups = 0;     // setters called with a name, each hashes a std::string
+    unsigned int uniformLocationQueries = 0; // glGetUniformLocation calls
+    unsigned int uniformUploads = 0;         // glUniform* calls
+    unsigned int uniformBufferUpdates = 0;   // FrameUniformBuffer uploads
+    unsigned int uniformUploadsSkipped = 0;  // per draw uniforms the render queue found unchanged
+
+    unsigned int drawCalls = 0;
+    unsigned int indirectDraws = 0; // commands issued through glMultiDrawElementsIndirect, which counts once in drawCalls
+    unsigned int instances = 0;     // model copies drawn by Model::DrawInstanced
+    unsigned long vertexBytes = 0; // bytes of the vertices the drawn indices reference, an estimate of vertex fetch
+    unsigned long triangles = 0;   // triangles submitted, all instances and levels of detail counted
+    unsigned int lodDraws = 0;     // draws (or indirect commands) of a coarser level of detail than the full mesh
+
+    // frustum culling of scene meshes
+    unsigned int meshesTested = 0;
+    unsigned int meshesCulled = 0;
+    unsigned int cullNodesVisited = 0; // Bvh nodes, 0 when culling tests every mesh
+    float cullMicroseconds = 0.0f; // CPU time of the culling pass
+
+    // occlusion culling of entities against the occluders (see Scene::occlusion)
+    unsigned int occlusionTested = 0;
+    unsigned int occlusionCulled = 0;
+    float occlusionMicroseconds = 0.0f; // CPU time, including the wait for the GPU results
+
+    // lit pass fragments passing the depth test, counted only while the overdraw view is shown
+    unsigned long shadedFragments = 0;
+    unsigned long coveredPixels = 0;
+
+    // point lights drawn as volumes by DeferredShading, 0 with forward shading
+    unsigned int lightVolumes = 0;
+
+    // GL state changes by kind, issued to the driver or filtered out by GLState as no-ops
+    unsigned int stateIssued[STATE_CALL_COUNT] = {};
+    unsigned int stateFiltered[STATE_CALL_COUNT] = {};
+
+    static FrameStats &Get()
+    {
+        static FrameStats stats;
+        return stats;
+    }
+
+    void Reset()
+    {
+        *this = FrameStats();
+    }
+
+    void Print(std::ostream &out = std::cout) const
+    {
+        out << "FRAME_STATS:: uniforms: " << uniformUploads << " uploads, " << uniformNameLookups << " by name, "
+            << uniformLocationQueries << " location queries, " << uniformBufferUpdates << " uniform buffer updates, "
+            << uniformUploadsSkipped << " skipped" << std::endl;
+        unsigned int issued = 0, filtered = 0;
+        for (int call = 0; call < STATE_CALL_COUNT; call++)
+        {
+            issued += stateIssued[call];
+            filtered += stateFiltered[call];
+        }
+        out << "FRAME_STATS:: " << drawCalls << " draws (" << indirectDraws << " indirect commands, " << instances << " instances) over " << vertexBytes / 1024 << " KB of vertices, " << triangles << " triangles, " << lodDraws << " at a lower level of detail, gl state calls: " << issued << " issued / " << filtered << " filtered";
+        for (int call = 0; call < STATE_CALL_COUNT; call++)
+            if (stateIssued[call] || stateFiltered[call])
+                out << ", " << STATE_CALL_NAMES[call] << " " << stateIssued[call] << " / " << stateFiltered[call];
+        out << std::endl;
+        out << "FRAME_STATS:: culling: " << meshesTested << " meshes tested, " << meshesCulled << " culled, "
+            << cullNodesVisited << " bvh nodes visited in " << cullMicroseconds << " us" << std::endl;
+        out << "FRAME_STATS:: occlusion: " << occlusionTested << " entities tested, " << occlusionCulled << " hidden in "
+            << occlusionMicroseconds << " us" << std::endl;
+        if (coveredPixels)
+            out << "FRAME_STATS:: overdraw: " << shadedFragments << " fragments shaded over " << coveredPixels << " pixels, "
+                << (double)shadedFragments / coveredPixels << " per pixel" << std::endl;
+        if (lightVolumes)
+            out << "FRAME_STATS:: deferred lighting: " << lightVolumes << " point light volumes" << std::endl;
+    }
+};
+#endif
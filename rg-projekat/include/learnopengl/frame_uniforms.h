@@ -0,0 +1,114 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <cstddef>
+#include <iostream>
+
+// Frame-global camera and light state, shared by all lit shaders through one std140 uniform
+// block. The structs below mirror the GLSL declaration in model_loading.vs and the .fs shaders
+// byte for byte, padding included, so the whole block goes up with a single glBufferSubData:
+//
+//     layout (std140) uniform FrameData {
+//         mat4 projection;
+//         mat4 view;
+//         vec3 viewPos;
+//         bool blinn;
+//         DirLight directional;
+//         SpotLight spotlight;
+//         PointLight pointLights[FRAME_POINT_LIGHTS];
+//     };
+//
+// Keep both sides in sync, Bind reports a size mismatch.
+const unsigned int FRAME_UNIFORMS_BINDING = 0;
+const unsigned int FRAME_POINT_LIGHTS = 2;
+
+struct DirLightStd140 {
+    glm::vec3 direction; float pad0;
+    glm::vec3 ambient;   float pad1;
+    glm::vec3 diffuse;   float pad2;
+    glm::vec3 specular;  float pad3;
+};
+
+struct PointLightStd140 {
+    glm::vec3 position; float pad0;
+    glm::vec3 ambient;  float pad1;
+    glm::vec3 diffuse;  float pad2;
+    glm::vec3 specular; float pad3;
+};
+
+struct SpotLightStd140 {
+    glm::vec3 position;  float pad0;
+    glm::vec3 direction; float cutOff;
+    float outerCutOff;   float pad1[3];
+    glm::vec3 ambient;   float pad2;
+    glm::vec3 diffuse;   float pad3;
+    glm::vec3 specular;  float pad4;
+};
+
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    GLint blinn; // GLSL bool, 4 bytes in std140
+    DirLightStd140 directional;
+    SpotLightStd140 spotlight;
+    PointLightStd140 pointLights[FRAME_POINT_LIGHTS];
+};
+
+static_assert(sizeof(DirLightStd140) == 64 && sizeof(PointLightStd140) == 64, "std140 light size");
+static_assert(sizeof(SpotLightStd140) == 96 && offsetof(SpotLightStd140, ambient) == 48, "std140 spotlight layout");
+static_assert(offsetof(FrameUniforms, blinn) == 140 && offsetof(FrameUniforms, directional) == 144
+              && offsetof(FrameUniforms, spotlight) == 208 && offsetof(FrameUniforms, pointLights) == 304,
+              "std140 FrameData layout");
+
+// the uniform buffer holding FrameUniforms, attached to FRAME_UNIFORMS_BINDING for its whole lifetime
+class FrameUniformBuffer {
+public:
+    unsigned int ID = 0;
+
+    // needs a current GL context
+    void Create()
+    {
+        glGenBuffers(1, &ID);
+        GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+        // also binds the generic GL_UNIFORM_BUFFER target, which is where GLState already has it
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, ID);
+    }
+
+    void Destroy()
+    {
+        GLState::Get().DeleteBuffer(ID);
+        ID = 0;
+    }
+
+    // points the FrameData block of shader at the shared binding, shaders without the block are left alone
+    static void Bind(const Shader &shader)
+    {
+        GLuint block = glGetUniformBlockIndex(shader.ID, "FrameData");
+        if (block == GL_INVALID_INDEX)
+            return;
+        GLint size = 0;
+        glGetActiveUniformBlockiv(shader.ID, block, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if (size != (GLint)sizeof(FrameUniforms))
+            std::cout << "ERROR::FRAME_UNIFORMS::BLOCK_SIZE_MISMATCH: shader " << size << " bytes, FrameUniforms "
+                      << sizeof(FrameUniforms) << " bytes" << std::endl;
+        glUniformBlockBinding(shader.ID, block, FRAME_UNIFORMS_BINDING);
+    }
+
+    // uploads the whole block, once per frame before the first draw
+    void Update(const FrameUniforms &frame) const
+    {
+        FrameStats::Get().uniformBufferUpdates++;
+        GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+    }
+};
+#endif
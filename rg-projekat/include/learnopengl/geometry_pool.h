@@ -0,0 +1,160 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/vertex_format.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// where a mesh lives in a GeometryPool, the arguments of its glDrawElementsBaseVertex
+struct GeometryRange {
+    GLint baseVertex = 0;
+    size_t indexOffset = 0;   // bytes into the element buffer
+    unsigned int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    unsigned int vertexCount = 0; // distinct vertices the indices reference, what a draw fetches
+};
+
+// One vertex buffer, element buffer and vertex array shared by all meshes of a model. Meshes are
+// added on the CPU, then Upload creates the GL objects in one go; every mesh then draws from the
+// same vertex array with its own base vertex and first index, so switching between the meshes
+// of a model binds nothing.
+//
+// Indices are relative to the mesh's base vertex, so they are 16 bit whenever the mesh itself
+// has at most 65536 vertices, however large the pool gets. Packed positions are quantized to
+// the bounds passed to the constructor, the same positionScale/positionOffset for every mesh.
+class GeometryPool {
+public:
+    unsigned int VAO = 0;
+    VertexLayout layout;
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+
+    GeometryPool() = default;
+
+    GeometryPool(const VertexLayout &layout, const MeshBounds &bounds) : layout(layout)
+    {
+        if (layout.format == VERTEX_FORMAT_PACKED)
+        {
+            positionOffset = bounds.min;
+            positionScale = bounds.max - bounds.min;
+        }
+    }
+
+    // appends a mesh, no GL calls
+    GeometryRange Add(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
+    {
+        GeometryRange range;
+        range.baseVertex = vertexCount;
+        range.indexCount = indices.size();
+        range.vertexCount = referencedVertices(indices);
+        vertexCount += vertices.size();
+        layout.Append(vertices, positionScale, positionOffset, vertexData);
+
+        range.indexType = vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        range.indexOffset = appendIndices(indices, range.indexType);
+        return range;
+    }
+
+    // appends another index buffer over the vertices of an added mesh, a level of detail
+    GeometryRange AddLod(const GeometryRange &base, const vector<unsigned int> &indices)
+    {
+        GeometryRange range = base;
+        range.indexCount = indices.size();
+        range.vertexCount = referencedVertices(indices);
+        range.indexOffset = appendIndices(indices, base.indexType);
+        return range;
+    }
+
+    // creates the buffers and the vertex array and frees the CPU copies. Needs a current GL context.
+    void Upload()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        GLState::Get().BindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size(), indexData.data(), GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        layout.SetupAttributes();
+        GLState::Get().BindVertexArray(0);
+
+        vertexBytes = vertexData.size();
+        indexBytes = indexData.size();
+        vector<unsigned char>().swap(vertexData);
+        vector<unsigned char>().swap(indexData);
+    }
+
+    void Destroy()
+    {
+        GLState::Get().DeleteVertexArray(VAO);
+        GLState::Get().DeleteBuffer(VBO);
+        GLState::Get().DeleteBuffer(EBO);
+        VAO = VBO = EBO = 0;
+    }
+
+    size_t VertexBytes() const
+    {
+        return VAO ? vertexBytes : vertexData.size();
+    }
+
+    size_t IndexBytes() const
+    {
+        return VAO ? indexBytes : indexData.size();
+    }
+
+private:
+    unsigned int VBO = 0, EBO = 0;
+    unsigned int vertexCount = 0;
+    vector<unsigned char> vertexData, indexData;
+    size_t vertexBytes = 0, indexBytes = 0;
+
+    // number of different vertices in indices, a level of detail leaves most of its mesh's unused
+    static unsigned int referencedVertices(const vector<unsigned int> &indices)
+    {
+        if (indices.empty())
+            return 0;
+        vector<bool> used(*max_element(indices.begin(), indices.end()) + 1, false);
+        unsigned int count = 0;
+        for (unsigned int index : indices)
+            if (!used[index])
+            {
+                used[index] = true;
+                count++;
+            }
+        return count;
+    }
+
+    // returns the byte offset of the indices in the element buffer
+    size_t appendIndices(const vector<unsigned int> &indices, GLenum indexType)
+    {
+        // keep every range aligned to its index size, 4 bytes covers both
+        indexData.resize((indexData.size() + 3) & ~(size_t)3);
+        size_t offset = indexData.size();
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            indexData.resize(offset + indices.size() * sizeof(uint16_t));
+            uint16_t *out = (uint16_t *)&indexData[offset];
+            for (size_t i = 0; i < indices.size(); i++)
+                out[i] = (uint16_t)indices[i];
+        }
+        else
+        {
+            indexData.resize(offset + indices.size() * sizeof(uint32_t));
+            memcpy(&indexData[offset], indices.data(), indices.size() * sizeof(uint32_t));
+        }
+        return offset;
+    }
+};
+#endif
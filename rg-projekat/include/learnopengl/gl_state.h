@@ -0,0 +1,245 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/frame_stats.h>
+
+// Shadow copy of the GL state the renderer changes. Every bind/enable goes through here and is
+// dropped when it would not change anything; FrameStats counts issued and filtered calls per kind.
+// Anything bypassing this class has to call Invalidate afterwards (or restore what it changed,
+// as the ImGui backend does). Element array buffers are vertex array state and are not tracked.
+class GLState {
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+    static GLState &Get()
+    {
+        static GLState state;
+        return state;
+    }
+
+    // forget everything, the next call of every kind is issued
+    void Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            for (unsigned int target = 0; target < TEXTURE_TARGETS; target++)
+                textures[unit][target] = UNKNOWN;
+        for (unsigned int target = 0; target < BUFFER_TARGETS; target++)
+            buffers[target] = UNKNOWN;
+        for (unsigned int capability = 0; capability < CAPABILITIES; capability++)
+            capabilities[capability] = UNKNOWN;
+        depthFunc = UNKNOWN;
+        depthMask = UNKNOWN;
+        cullFace = UNKNOWN;
+        blendSource = UNKNOWN;
+        blendDestination = UNKNOWN;
+        colorMask = UNKNOWN;
+    }
+
+    void UseProgram(GLuint id)
+    {
+        if (changed(program, id, STATE_PROGRAM))
+            glUseProgram(id);
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (changed(vertexArray, id, STATE_VERTEX_ARRAY))
+            glBindVertexArray(id);
+    }
+
+    void ActiveTexture(unsigned int unit)
+    {
+        if (changed(activeUnit, unit, STATE_ACTIVE_TEXTURE))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds texture to target on unit, switching the active unit only when the binding changes
+    void BindTexture(unsigned int unit, GLenum target, GLuint texture)
+    {
+        int slot = textureSlot(target);
+        if (slot < 0 || unit >= MAX_TEXTURE_UNITS)
+        {
+            ActiveTexture(unit);
+            issue(STATE_TEXTURE);
+            glBindTexture(target, texture);
+            return;
+        }
+        if (textures[unit][slot] == texture)
+        {
+            FrameStats::Get().stateFiltered[STATE_TEXTURE]++;
+            return;
+        }
+        ActiveTexture(unit);
+        textures[unit][slot] = texture;
+        issue(STATE_TEXTURE);
+        glBindTexture(target, texture);
+    }
+
+    // binds texture to target on whichever unit is active, for uploads
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        if (activeUnit == UNKNOWN)
+            ActiveTexture(0);
+        BindTexture(activeUnit, target, texture);
+    }
+
+    void BindBuffer(GLenum target, GLuint buffer)
+    {
+        int slot = bufferSlot(target);
+        if (slot < 0)
+        {
+            issue(STATE_BUFFER);
+            glBindBuffer(target, buffer);
+        }
+        else if (changed(buffers[slot], buffer, STATE_BUFFER))
+            glBindBuffer(target, buffer);
+    }
+
+    void Enable(GLenum capability)
+    {
+        setCapability(capability, true);
+    }
+
+    void Disable(GLenum capability)
+    {
+        setCapability(capability, false);
+    }
+
+    void DepthFunc(GLenum func)
+    {
+        if (changed(depthFunc, func, STATE_DEPTH))
+            glDepthFunc(func);
+    }
+
+    void DepthMask(bool write)
+    {
+        if (changed(depthMask, write ? 1 : 0, STATE_DEPTH))
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    // all four channels at once, the renderer never writes only some of them
+    void ColorMask(bool write)
+    {
+        if (changed(colorMask, write ? 1 : 0, STATE_COLOR_MASK))
+            glColorMask(write, write, write, write);
+    }
+
+    void CullFace(GLenum mode)
+    {
+        if (changed(cullFace, mode, STATE_CULL_FACE))
+            glCullFace(mode);
+    }
+
+    void BlendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == source && blendDestination == destination)
+        {
+            FrameStats::Get().stateFiltered[STATE_BLEND_FUNC]++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        issue(STATE_BLEND_FUNC);
+        glBlendFunc(source, destination);
+    }
+
+    // deleting an object unbinds it, so names GL hands out again must not look bound
+    void DeleteTexture(GLuint texture)
+    {
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            for (unsigned int target = 0; target < TEXTURE_TARGETS; target++)
+                if (textures[unit][target] == texture)
+                    textures[unit][target] = 0;
+        glDeleteTextures(1, &texture);
+    }
+
+    void DeleteVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = 0;
+        glDeleteVertexArrays(1, &id);
+    }
+
+    void DeleteBuffer(GLuint buffer)
+    {
+        for (unsigned int target = 0; target < BUFFER_TARGETS; target++)
+            if (buffers[target] == buffer)
+                buffers[target] = 0;
+        glDeleteBuffers(1, &buffer);
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+    static const unsigned int TEXTURE_TARGETS = 3;
+    static const unsigned int BUFFER_TARGETS = 2;
+    static const unsigned int CAPABILITIES = 3;
+
+    GLuint program, vertexArray, activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+    GLuint buffers[BUFFER_TARGETS];
+    GLuint capabilities[CAPABILITIES];
+    GLuint depthFunc, depthMask, cullFace, blendSource, blendDestination, colorMask;
+
+    GLState()
+    {
+        Invalidate();
+    }
+
+    static void issue(StateCall call)
+    {
+        FrameStats::Get().stateIssued[call]++;
+    }
+
+    // updates the shadow value and tells whether the GL call is needed
+    static bool changed(GLuint &current, GLuint value, StateCall call)
+    {
+        if (current == value)
+        {
+            FrameStats::Get().stateFiltered[call]++;
+            return false;
+        }
+        current = value;
+        issue(call);
+        return true;
+    }
+
+    void setCapability(GLenum capability, bool enabled)
+    {
+        int slot = capability == GL_DEPTH_TEST ? 0 : capability == GL_BLEND ? 1 : capability == GL_CULL_FACE ? 2 : -1;
+        if (slot >= 0 && !changed(capabilities[slot], enabled ? 1 : 0, STATE_CAPABILITY))
+            return;
+        if (slot < 0)
+            issue(STATE_CAPABILITY);
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_TEXTURE_2D: return 0;
+            case GL_TEXTURE_CUBE_MAP: return 1;
+            case GL_TEXTURE_2D_ARRAY: return 2;
+            default: return -1;
+        }
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_ARRAY_BUFFER: return 0;
+            case GL_UNIFORM_BUFFER: return 1;
+            default: return -1;
+        }
+    }
+};
+#endif
@@ -0,0 +1,351 @@
+#ifndef HIZ_OCCLUSION_H
+#define HIZ_OCCLUSION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <vector>
+using namespace std;
+
+// GPU occlusion culling against a hierarchical depth buffer, all in GL 3.3:
+//
+//   1. Begin/DrawOccluder render the occluders depth only into a WIDTH x HEIGHT depth texture
+//      (power of two, so every level halves exactly; texels need not be square)
+//   2. Test erodes that into level 0 of the pyramid with hiz_erode.fs, the farthest depth of
+//      every texel's 3x3 neighbourhood: the occluders were sampled at texel centers only, and
+//      this way a texel occludes only where they cover all of it (see DepthPyramid). It builds
+//      the other mip levels with hiz_downsample.fs, each the farthest depth of the 2x2 texels
+//      below, then draws one point per box with occlusion_test.vs, which tests the box
+//      against the level where it spans at most 2x2 texels and writes 0 (hidden) or 1 to the
+//      box's texel of a small result target, and copies that into a pixel pack buffer.
+//
+// The copy is read once its fence has passed, so the CPU never waits for the GPU, and culling
+// lags the view by one frame: Test hides a box only if the previous frame's test has finished
+// and found the box of the same id hidden. Results two or more frames old are dropped, so an
+// entity the camera has just revealed is culled for one frame at most, and ids the previous
+// test did not include (outside last frame's frustum) are visible. Up to READBACK_FRAMES tests
+// are in flight; when the GPU is that far behind a frame queues none and the next one culls
+// nothing. DepthPyramid is the CPU side of the same test.
+class HiZOcclusion {
+public:
+    static const int WIDTH = 512;
+    static const int HEIGHT = 256;
+    static const int RESULT_WIDTH = 256; // result texels per row, one per box
+    static const int READBACK_FRAMES = 3;
+
+    void Create()
+    {
+        depthShader.reset(new Shader("resources/shaders/occluder_depth.vs", "resources/shaders/occluder_depth.fs"));
+        erodeShader.reset(new Shader("resources/shaders/fullscreen_triangle.vs", "resources/shaders/hiz_erode.fs"));
+        downsampleShader.reset(new Shader("resources/shaders/fullscreen_triangle.vs", "resources/shaders/hiz_downsample.fs"));
+        testShader.reset(new Shader("resources/shaders/occlusion_test.vs", "resources/shaders/occlusion_test.fs"));
+        viewProjectionLocation = depthShader->uniform("viewProjection");
+        modelLocation = depthShader->uniform("model");
+        positionScaleLocation = depthShader->uniform("positionScale");
+        positionOffsetLocation = depthShader->uniform("positionOffset");
+        belowSizeLocation = downsampleShader->uniform("belowSize");
+        testViewProjectionLocation = testShader->uniform("viewProjection");
+        resultSizeLocation = testShader->uniform("resultSize");
+        // uniforms that never change, so the frame sets none by name
+        erodeShader->use();
+        erodeShader->setInt(erodeShader->uniform("depth"), 0);
+        erodeShader->setIVec2(erodeShader->uniform("size"), glm::ivec2(WIDTH, HEIGHT));
+        downsampleShader->use();
+        downsampleShader->setInt(downsampleShader->uniform("depth"), 0);
+
+        levels = 1;
+        while ((WIDTH >> levels) > 0 || (HEIGHT >> levels) > 0)
+            levels++;
+        testShader->use();
+        testShader->setInt(testShader->uniform("hiz"), 0);
+        testShader->setInt(testShader->uniform("levels"), levels);
+        glGenTextures(1, &depthTexture);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, depthTexture);
+        for (int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_DEPTH_COMPONENT32F, std::max(1, WIDTH >> level),
+                         std::max(1, HEIGHT >> level), 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        glGenTextures(1, &occluderTexture);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, occluderTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, WIDTH, HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glGenFramebuffers(1, &resultFramebuffer);
+        glGenVertexArrays(1, &emptyVAO);
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxBuffer);
+        for (Readback &readback : readbacks)
+            glGenBuffers(1, &readback.buffer);
+        GLState::Get().BindVertexArray(boxVAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)sizeof(glm::vec3));
+        GLState::Get().BindVertexArray(0);
+    }
+
+    void Destroy()
+    {
+        if (!framebuffer)
+            return;
+        depthShader.reset();
+        erodeShader.reset();
+        downsampleShader.reset();
+        testShader.reset();
+        GLState::Get().DeleteTexture(depthTexture);
+        GLState::Get().DeleteTexture(occluderTexture);
+        GLState::Get().DeleteTexture(resultTexture);
+        GLState::Get().DeleteVertexArray(emptyVAO);
+        GLState::Get().DeleteVertexArray(boxVAO);
+        GLState::Get().DeleteBuffer(boxBuffer);
+        for (Readback &readback : readbacks)
+        {
+            if (readback.fence)
+                glDeleteSync(readback.fence);
+            GLState::Get().DeleteBuffer(readback.buffer);
+            readback = Readback();
+        }
+        firstReadback = pendingReadbacks = 0;
+        hiddenIds.clear();
+        frame = resultFrame = 0;
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteFramebuffers(1, &resultFramebuffer);
+        framebuffer = resultFramebuffer = depthTexture = occluderTexture = resultTexture = 0;
+        resultRows = 0;
+    }
+
+    // starts the occluder pass: clears the occluder depth and sets up the depth only program.
+    // Test binds targetFramebuffer and sets targetViewport again, where the frame renders to; they
+    // are passed in, querying GL for them would wait for the GPU.
+    void Begin(const glm::mat4 &viewProjection, unsigned int targetFramebuffer, const glm::ivec4 &targetViewport)
+    {
+        savedFramebuffer = targetFramebuffer;
+        savedViewport = targetViewport;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, occluderTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glViewport(0, 0, WIDTH, HEIGHT);
+        GLState::Get().DepthMask(true);
+        GLState::Get().DepthFunc(GL_LESS);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader->use();
+        depthShader->setMat4(viewProjectionLocation, viewProjection);
+    }
+
+    // draws one mesh of an occluder, full detail
+    void DrawOccluder(const Mesh &mesh, const glm::mat4 &transform)
+    {
+        depthShader->setMat4(modelLocation, transform);
+        depthShader->setVec3(positionScaleLocation, mesh.positionScale);
+        depthShader->setVec3(positionOffsetLocation, mesh.positionOffset);
+        GLState::Get().BindVertexArray(mesh.VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, mesh.geometry.indexCount, mesh.geometry.indexType,
+                                 (void*)mesh.geometry.indexOffset, mesh.geometry.baseVertex);
+        FrameStats::Get().drawCalls++;
+    }
+
+    // counts a frame that tests nothing, so the next one does not take older results for its
+    // previous frame's
+    void Skip()
+    {
+        frame++;
+    }
+
+    // builds the pyramid from the occluders drawn since Begin and queues the test of the world
+    // space boxes, ids[i] naming boxes[i] (e.g. its entity). visible[i] is 0 if the previous
+    // frame's test has finished and found the box of ids[i] hidden. Restores the framebuffer and
+    // viewport of Begin.
+    void Test(const vector<MeshBounds> &boxes, const vector<unsigned int> &ids, const glm::mat4 &viewProjection,
+              vector<unsigned char> &visible)
+    {
+        GLState &state = GLState::Get();
+        FrameStats &stats = FrameStats::Get();
+
+        frame++;
+        collectReadbacks();
+        bool current = resultFrame + 1 == frame;
+        visible.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++)
+            visible[i] = !current || ids[i] >= hiddenIds.size() || !hiddenIds[ids[i]];
+        if (boxes.empty() || pendingReadbacks == READBACK_FRAMES)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+            glViewport(savedViewport.x, savedViewport.y, savedViewport.z, savedViewport.w);
+            return;
+        }
+
+        // level 0, eroded from the occluder pass
+        state.DepthFunc(GL_ALWAYS);
+        state.BindVertexArray(emptyVAO);
+        attachLevel(0);
+        erodeShader->use();
+        state.BindTexture(0, GL_TEXTURE_2D, occluderTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        stats.drawCalls++;
+
+        // mip levels, each reading only the one below
+        downsampleShader->use();
+        state.BindTexture(0, GL_TEXTURE_2D, depthTexture);
+        for (int level = 1; level < levels; level++)
+        {
+            attachLevel(level);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            glViewport(0, 0, std::max(1, WIDTH >> level), std::max(1, HEIGHT >> level));
+            downsampleShader->setIVec2(belowSizeLocation,
+                                       glm::ivec2(std::max(1, WIDTH >> (level - 1)), std::max(1, HEIGHT >> (level - 1))));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            stats.drawCalls++;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        state.DepthFunc(GL_LESS);
+
+        int rows = (boxes.size() + RESULT_WIDTH - 1) / RESULT_WIDTH;
+        resizeResult(rows);
+        glBindFramebuffer(GL_FRAMEBUFFER, resultFramebuffer);
+        glViewport(0, 0, RESULT_WIDTH, rows);
+
+        boxData.clear();
+        for (const MeshBounds &box : boxes)
+        {
+            boxData.push_back(box.min);
+            boxData.push_back(box.max);
+        }
+        state.BindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+        glBufferData(GL_ARRAY_BUFFER, boxData.size() * sizeof(glm::vec3), boxData.data(), GL_STREAM_DRAW);
+
+        // the result target has no depth buffer, and alpha 1 passes blending unchanged
+        testShader->use();
+        testShader->setMat4(testViewProjectionLocation, viewProjection);
+        testShader->setIVec2(resultSizeLocation, glm::ivec2(RESULT_WIDTH, rows));
+        state.BindVertexArray(boxVAO);
+        glDrawArrays(GL_POINTS, 0, boxes.size());
+        stats.drawCalls++;
+
+        // into the next free pack buffer, read by collectReadbacks once the fence has passed
+        Readback &readback = readbacks[(firstReadback + pendingReadbacks++) % READBACK_FRAMES];
+        size_t bytes = (size_t)RESULT_WIDTH * rows;
+        state.BindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        if (bytes > readback.capacity)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+            readback.capacity = bytes;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, RESULT_WIDTH, rows, GL_RED, GL_UNSIGNED_BYTE, (void*)0);
+        state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.ids = ids;
+        readback.frame = frame;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+        glViewport(savedViewport.x, savedViewport.y, savedViewport.z, savedViewport.w);
+    }
+
+private:
+    unique_ptr<Shader> depthShader, erodeShader, downsampleShader, testShader;
+    GLint viewProjectionLocation = -1, modelLocation = -1, positionScaleLocation = -1, positionOffsetLocation = -1;
+    GLint belowSizeLocation = -1, testViewProjectionLocation = -1, resultSizeLocation = -1;
+    int levels = 0;
+    unsigned int depthTexture = 0, occluderTexture = 0, framebuffer = 0;
+    unsigned int resultTexture = 0, resultFramebuffer = 0;
+    int resultRows = 0;
+    unsigned int emptyVAO = 0, boxVAO = 0, boxBuffer = 0;
+    glm::ivec4 savedViewport = glm::ivec4(0);
+    unsigned int savedFramebuffer = 0;
+    vector<glm::vec3> boxData;
+
+    // a queued test: its results in buffer once fence has passed, for the boxes of ids
+    struct Readback {
+        unsigned int buffer = 0;
+        size_t capacity = 0;
+        GLsync fence = 0;
+        vector<unsigned int> ids;
+        unsigned long frame = 0;
+    };
+    Readback readbacks[READBACK_FRAMES]; // a ring, pendingReadbacks of them queued from firstReadback on
+    int firstReadback = 0, pendingReadbacks = 0;
+    vector<unsigned char> hiddenIds; // 1 for the ids the latest finished test found hidden
+    unsigned long frame = 0;         // Test calls so far
+    unsigned long resultFrame = 0;   // the frame whose test hiddenIds came from, 0 for none
+
+    // takes the results of every queued test that has finished, oldest first, without waiting
+    void collectReadbacks()
+    {
+        while (pendingReadbacks > 0)
+        {
+            Readback &readback = readbacks[firstReadback];
+            GLenum status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            glDeleteSync(readback.fence);
+            readback.fence = 0;
+            firstReadback = (firstReadback + 1) % READBACK_FRAMES;
+            pendingReadbacks--;
+            resultFrame = readback.frame;
+
+            GLState::Get().BindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            const unsigned char *result = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback.ids.size(),
+                                                                                  GL_MAP_READ_BIT);
+            hiddenIds.assign(hiddenIds.size(), 0);
+            if (result)
+            {
+                for (size_t i = 0; i < readback.ids.size(); i++)
+                {
+                    if (readback.ids[i] >= hiddenIds.size())
+                        hiddenIds.resize(readback.ids[i] + 1, 0);
+                    hiddenIds[readback.ids[i]] = result[i] <= 127;
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            GLState::Get().BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    void attachLevel(int level)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, level);
+    }
+
+    // an R8 target with room for rows * RESULT_WIDTH boxes
+    void resizeResult(int rows)
+    {
+        if (rows <= resultRows)
+            return;
+        resultRows = rows;
+        if (!resultTexture)
+            glGenTextures(1, &resultTexture);
+        GLState::Get().BindTexture(1, GL_TEXTURE_2D, resultTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, RESULT_WIDTH, rows, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, resultFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resultTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::HIZ_OCCLUSION:: result framebuffer not complete" << endl;
+    }
+};
+#endif
@@ -6,134 +6,252 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <learnopengl/shader.h>
+#include <learnopengl/bounds.h>
+#include <learnopengl/geometry_pool.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+#include <learnopengl/texture_array.h>
+#include <learnopengl/vertex_format.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-};
-
-
-
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// a coarser level of detail of a mesh, indices into the same vertices (see MeshSimplifier)
+struct MeshLod {
+    vector<unsigned int> indices;
+    float error; // how far the surface moved, in model units
 };
 
 class Mesh {
 public:
-    // mesh Data
-    vector<Vertex>       vertices;
-    vector<unsigned int> indices;
+    // mesh Data, the vertices and indices only live in the pool
+    unsigned int         vertexCount;
     vector<Texture>      textures;
+    MeshBounds           bounds; // model space
 
-    unsigned int VAO;
+    unsigned int VAO = 0;   // the pool's vertex array, set by the pool's owner after GeometryPool::Upload
+    GeometryRange geometry; // where the vertices and indices are in the pool
+    vector<GeometryRange> lods; // coarser levels of detail in the same pool, geometry is level 0
+    vector<float> lodErrors;    // how far each level moved the surface, in model units
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    unsigned int vertexStride;
+    // position = positionOffset + attribute * positionScale in the vertex shader, identity for floats
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+    // layer of the first diffuse and specular texture, for textures in arrays (see TextureArrays)
+    glm::ivec2 textureLayers;
+    // color of the first diffuse and specular texture when it is constant, alpha 1 then; zero
+    // means sample the texture
+    glm::vec4 diffuseColor;
+    glm::vec4 specularColor;
+
+    // constructor, adds the mesh and its levels of detail to pool (no GL calls, neither the
+    // vertices nor the indices are kept) and computes the bounds unless they are passed in
+    Mesh(vector<Vertex> vertices, const vector<unsigned int> &indices, vector<Texture> textures, GeometryPool &pool,
+         const MeshBounds *bounds = nullptr, const vector<MeshLod> *lodIndices = nullptr)
+    {
+        vertexCount = vertices.size();
+        this->textures = std::move(textures);
+        this->bounds = bounds ? *bounds : MeshBounds::FromVertices(vertices);
+        geometry = pool.Add(vertices, indices);
+        lodErrors.push_back(0.0f);
+        if (lodIndices)
+            for (const MeshLod &lod : *lodIndices)
+            {
+                lods.push_back(pool.AddLod(geometry, lod.indices));
+                lodErrors.push_back(lod.error);
+            }
+        vertexStride = pool.layout.stride;
+        positionScale = pool.positionScale;
+        positionOffset = pool.positionOffset;
+
+        updateSamplerNames();
+    }
+
+    void SetShaderTextureNamePrefix(const std::string &prefix)
+    {
+        glslIdentifierPrefix = prefix;
+        updateSamplerNames();
+    }
+
+    // location of the sampler uniform of every texture in shader. Resolved once per program, not every frame,
+    // together with the position dequantization, texture layer and constant color uniforms.
+    const vector<GLint> &SamplerLocations(const Shader &shader)
+    {
+        if (samplerProgram != shader.ID)
+        {
+            samplerProgram = shader.ID;
+            samplerLocations.clear();
+            for (const string &name : samplerNames)
+                samplerLocations.push_back(shader.uniform(name));
+            positionScaleLocation = shader.uniform("positionScale");
+            positionOffsetLocation = shader.uniform("positionOffset");
+            textureLayersLocation = shader.uniform("textureLayers");
+            diffuseColorLocation = shader.uniform("diffuseColor");
+            specularColorLocation = shader.uniform("specularColor");
+        }
+        return samplerLocations;
+    }
+
+    // indices of a level of detail, the coarsest one the mesh has for higher levels
+    const GeometryRange &Lod(unsigned int level) const
+    {
+        if (level == 0 || lods.empty())
+            return geometry;
+        return lods[std::min<size_t>(level, lods.size()) - 1];
+    }
+
+    // surface error of Lod(level)
+    float LodError(unsigned int level) const
+    {
+        return lodErrors[std::min<size_t>(level, lodErrors.size() - 1)];
+    }
+
+    // bytes of one vertex in the vertex buffer
+    unsigned int VertexStride() const
+    {
+        return vertexStride;
+    }
+
+    // bytes of the vertices a draw of Lod(level) reads, those its indices reference
+    size_t DrawnVertexBytes(unsigned int level) const
+    {
+        return (size_t)Lod(level).vertexCount * vertexStride;
+    }
+
+    // bytes of the mesh's indices
+    size_t IndexBytes() const
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        return (size_t)geometry.indexCount * (geometry.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+    }
+
+    // render the mesh, at a level of detail
+    void Draw(Shader &shader, unsigned int lod = 0)
+    {
+        bind(shader);
+        const GeometryRange &range = Lod(lod);
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, (void*)range.indexOffset,
+                                 range.baseVertex);
+        FrameStats::Get().drawCalls++;
+        FrameStats::Get().triangles += range.indexCount / 3;
+        FrameStats::Get().lodDraws += lod > 0;
+        FrameStats::Get().vertexBytes += DrawnVertexBytes(lod);
+    }
+
+    // render instanceCount copies of the mesh in one call, the per instance attributes have to be
+    // set up on the vertex array (see Model::DrawInstanced)
+    void DrawInstanced(Shader &shader, unsigned int instanceCount, unsigned int lod = 0)
+    {
+        bind(shader);
+        drawInstances(instanceCount, lod);
+    }
+
+    // positions only, for the depth pre-pass: no textures or material uniforms
+    void DrawInstancedDepth(Shader &shader, GLint positionScaleLocation, GLint positionOffsetLocation,
+                            unsigned int instanceCount, unsigned int lod = 0)
+    {
+        shader.setVec3(positionScaleLocation, positionScale);
+        shader.setVec3(positionOffsetLocation, positionOffset);
+        GLState::Get().BindVertexArray(VAO);
+        drawInstances(instanceCount, lod);
+    }
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+private:
+    void drawInstances(unsigned int instanceCount, unsigned int lod)
+    {
+        const GeometryRange &range = Lod(lod);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType,
+                                          (void*)range.indexOffset, instanceCount, range.baseVertex);
+        FrameStats::Get().drawCalls++;
+        FrameStats::Get().triangles += range.indexCount / 3 * instanceCount;
+        FrameStats::Get().lodDraws += lod > 0;
+        FrameStats::Get().vertexBytes += DrawnVertexBytes(lod);
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // sampler uniform of every texture (e.g. material.texture_diffuse1) and its location in samplerProgram
+    vector<string> samplerNames;
+    vector<GLint> samplerLocations;
+    GLint positionScaleLocation = -1, positionOffsetLocation = -1, textureLayersLocation = -1;
+    GLint diffuseColorLocation = -1, specularColorLocation = -1;
+    unsigned int samplerProgram = 0;
+
+    // textures, sampler and dequantization uniforms and vertex array of a draw
+    void bind(Shader &shader)
+    {
+        SamplerLocations(shader);
+
+        // bind appropriate textures, constant ones are passed as colors instead
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            if (textures[i].constant)
+                continue;
+            // now set the sampler to the correct texture unit
+            shader.setInt(samplerLocations[i], i);
+            // and bind the texture, GLState skips the unit switch and bind when it is already there
+            GLState::Get().BindTexture(i, textures[i].target, textures[i].id);
+        }
+        if (textureLayersLocation >= 0)
+            shader.setIVec2(textureLayersLocation, textureLayers);
+        shader.setVec4(diffuseColorLocation, diffuseColor);
+        shader.setVec4(specularColorLocation, specularColor);
+
+        // dequantization of packed positions
+        shader.setVec3(positionScaleLocation, positionScale);
+        shader.setVec3(positionOffsetLocation, positionOffset);
+
+        GLState::Get().BindVertexArray(VAO);
+    }
+
+    // retrieves the texture number (the N in diffuse_textureN) of every texture
+    void updateSamplerNames()
     {
-        // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        samplerNames.clear();
+        textureLayers = glm::ivec2(0, 0);
+        diffuseColor = specularColor = glm::vec4(0.0f);
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
             if(name == "texture_diffuse")
+            {
+                if (diffuseNr == 1)
+                {
+                    textureLayers.x = textures[i].layer;
+                    diffuseColor = constantColor(textures[i]);
+                }
                 number = std::to_string(diffuseNr++);
+            }
             else if(name == "texture_specular")
+            {
+                if (specularNr == 1)
+                {
+                    textureLayers.y = textures[i].layer;
+                    specularColor = constantColor(textures[i]);
+                }
                 number = std::to_string(specularNr++); // transfer unsigned int to stream
+            }
             else if(name == "texture_normal")
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerNames.push_back(glslIdentifierPrefix + name + number);
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        // without a specular map the specular sampler reads unit 0, the diffuse map's, so it
+        // follows a constant diffuse color too
+        if (specularNr == 1)
+            specularColor = diffuseColor;
+        samplerProgram = 0;
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    static glm::vec4 constantColor(const Texture &texture)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        return texture.constant ? glm::vec4(glm::vec3(texture.color), 1.0f) : glm::vec4(0.0f);
     }
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,469 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// CPU side copy of an imported model, independent of any GL state. This is what gets
+// written to / read from the binary cache, and what Model turns into GL meshes.
+struct TextureRef {
+    string type;
+    string path;
+};
+
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<unsigned int> textures; // indices into ModelData::textures
+    MeshBounds           bounds;
+    vector<MeshLod>      lods;     // coarsest last
+};
+
+struct ModelData {
+    vector<MeshData>   meshes;
+    vector<TextureRef> textures;
+};
+
+// Binary cache stored next to the source asset as <asset>.rgcache
+//
+// layout:
+//   MeshCacheHeader
+//   MeshCacheEntry    [meshCount]
+//   MeshCacheTexture  [textureCount]
+//   MeshCacheMaterial [materialCount]
+//   MeshCacheLod      [lodCount of every mesh], in mesh order
+//   uint32_t          texture indices of every mesh, back to back
+//   char              string blob (texture types and paths, material library paths)
+//   Vertex            vertices of every mesh, 16 byte aligned
+//   uint32_t          indices of every mesh and then of its levels of detail, 16 byte aligned
+//
+// The cache is valid while the source file and the material libraries it names (the .mtl of an
+// .obj, whose texture table the cache holds) have the same mtime and size. If only the mtime
+// changed (e.g. after a fresh checkout) the file is hashed, and when the content hash matches
+// the cache is still used and its recorded mtime updated, so the next start skips the hash. A
+// cache written with a different cluster size is not used either. Bump MESH_CACHE_VERSION
+// whenever the layout, Vertex or the import processing (e.g. MeshOptimizer) changes.
+const uint32_t MESH_CACHE_VERSION = 6;
+const char MESH_CACHE_MAGIC[4] = {'R', 'G', 'M', 'C'};
+
+struct MeshCacheHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t clusterTriangles; // MeshClusterer cluster size the meshes were split with, 0 if not
+    uint32_t materialCount;
+    uint32_t padding;
+    int64_t  sourceMtime;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+};
+
+struct MeshCacheEntry {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t lodCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t textureOffset;
+    MeshBounds bounds;
+};
+
+struct MeshCacheTexture {
+    uint32_t typeOffset;
+    uint32_t typeLength;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+// a material library the source refers to, checked like the source itself
+struct MeshCacheMaterial {
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    int64_t  mtime;
+    uint64_t size;
+    uint64_t hash;
+};
+
+struct MeshCacheLod {
+    uint32_t indexCount;
+    float    error;
+    uint64_t indexOffset;
+};
+
+// read-only memory mapping of a whole file, unmapped when it goes out of scope
+class MappedFile {
+public:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    explicit MappedFile(const string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED)
+            {
+                data = static_cast<const unsigned char *>(ptr);
+                size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile()
+    {
+        if (data)
+            munmap(const_cast<unsigned char *>(data), size);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+
+class MeshCache {
+public:
+    static string cachePath(const string &sourcePath)
+    {
+        return sourcePath + ".rgcache";
+    }
+
+    // 64 bit FNV-1a
+    static uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t hashFile(const string &path)
+    {
+        MappedFile file(path);
+        return hashBytes(file.data, file.size);
+    }
+
+    // fills data from the cache of sourcePath, returns false if there is no usable cache
+    static bool read(const string &sourcePath, ModelData &data, uint32_t clusterTriangles = 0)
+    {
+        MappedFile file(cachePath(sourcePath));
+        if (!file.data || file.size < sizeof(MeshCacheHeader))
+            return false;
+
+        MeshCacheHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        if (memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != MESH_CACHE_VERSION
+            || header.vertexSize != sizeof(Vertex) || header.clusterTriangles != clusterTriangles)
+            return false;
+        bool touched = false;
+        if (!unchanged(sourcePath, header.sourceMtime, header.sourceSize, header.sourceHash, touched))
+            return false;
+
+        size_t tableEnd = sizeof(MeshCacheHeader) + header.meshCount * sizeof(MeshCacheEntry)
+                          + header.textureCount * sizeof(MeshCacheTexture) + header.materialCount * sizeof(MeshCacheMaterial);
+        if (tableEnd > file.size)
+            return false;
+        const unsigned char *entries = file.data + sizeof(MeshCacheHeader);
+        const unsigned char *textures = entries + header.meshCount * sizeof(MeshCacheEntry);
+        const unsigned char *materialTable = textures + header.textureCount * sizeof(MeshCacheTexture);
+        const unsigned char *lods = materialTable + header.materialCount * sizeof(MeshCacheMaterial);
+
+        vector<MeshCacheMaterial> materials(header.materialCount);
+        if (!materials.empty())
+            memcpy(materials.data(), materialTable, materials.size() * sizeof(MeshCacheMaterial));
+        for (MeshCacheMaterial &material : materials)
+        {
+            if (!inBounds(file, material.pathOffset, material.pathLength))
+                return false;
+            string path((const char *)file.data + material.pathOffset, material.pathLength);
+            if (!unchanged(path, material.mtime, material.size, material.hash, touched))
+                return false;
+        }
+
+        data.textures.resize(header.textureCount);
+        for (uint32_t i = 0; i < header.textureCount; i++)
+        {
+            MeshCacheTexture texture;
+            memcpy(&texture, textures + i * sizeof(MeshCacheTexture), sizeof(texture));
+            if (!inBounds(file, texture.typeOffset, texture.typeLength) || !inBounds(file, texture.pathOffset, texture.pathLength))
+                return false;
+            data.textures[i].type.assign((const char *)file.data + texture.typeOffset, texture.typeLength);
+            data.textures[i].path.assign((const char *)file.data + texture.pathOffset, texture.pathLength);
+        }
+
+        data.meshes.resize(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; i++)
+        {
+            MeshCacheEntry entry;
+            memcpy(&entry, entries + i * sizeof(MeshCacheEntry), sizeof(entry));
+            if (!inBounds(file, entry.vertexOffset, (uint64_t)entry.vertexCount * sizeof(Vertex))
+                || !inBounds(file, entry.indexOffset, (uint64_t)entry.indexCount * sizeof(uint32_t))
+                || !inBounds(file, entry.textureOffset, (uint64_t)entry.textureCount * sizeof(uint32_t)))
+                return false;
+
+            MeshData &mesh = data.meshes[i];
+            mesh.vertices.resize(entry.vertexCount);
+            mesh.indices.resize(entry.indexCount);
+            mesh.textures.resize(entry.textureCount);
+            mesh.bounds = entry.bounds;
+            memcpy(mesh.vertices.data(), file.data + entry.vertexOffset, entry.vertexCount * sizeof(Vertex));
+            memcpy(mesh.indices.data(), file.data + entry.indexOffset, entry.indexCount * sizeof(uint32_t));
+            memcpy(mesh.textures.data(), file.data + entry.textureOffset, entry.textureCount * sizeof(uint32_t));
+            for (unsigned int texture : mesh.textures)
+                if (texture >= header.textureCount)
+                    return false;
+
+            if (!inBounds(file, lods - file.data, (uint64_t)entry.lodCount * sizeof(MeshCacheLod)))
+                return false;
+            mesh.lods.resize(entry.lodCount);
+            for (uint32_t level = 0; level < entry.lodCount; level++)
+            {
+                MeshCacheLod lod;
+                memcpy(&lod, lods + level * sizeof(MeshCacheLod), sizeof(lod));
+                if (!inBounds(file, lod.indexOffset, (uint64_t)lod.indexCount * sizeof(uint32_t)))
+                    return false;
+                mesh.lods[level].indices.resize(lod.indexCount);
+                mesh.lods[level].error = lod.error;
+                memcpy(mesh.lods[level].indices.data(), file.data + lod.indexOffset, lod.indexCount * sizeof(uint32_t));
+            }
+            lods += entry.lodCount * sizeof(MeshCacheLod);
+        }
+
+        // record the new mtimes in place, a failure only means hashing again next time
+        if (touched)
+        {
+            int fd = open(cachePath(sourcePath).c_str(), O_WRONLY);
+            if (fd >= 0)
+            {
+                if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+                    || pwrite(fd, materials.data(), materials.size() * sizeof(MeshCacheMaterial),
+                              materialTable - file.data) != (ssize_t)(materials.size() * sizeof(MeshCacheMaterial)))
+                    cout << "WARNING::MESH_CACHE:: could not update " << cachePath(sourcePath) << endl;
+                close(fd);
+            }
+        }
+        return true;
+    }
+
+    static bool write(const string &sourcePath, const ModelData &data, uint32_t clusterTriangles = 0)
+    {
+        struct stat st;
+        if (stat(sourcePath.c_str(), &st) != 0)
+            return false;
+
+        vector<string> materialPaths = materialLibraries(sourcePath);
+        vector<MeshCacheMaterial> materials;
+        for (const string &materialPath : materialPaths)
+        {
+            // a library missing now has to stay missing, the import went without its materials
+            struct stat materialStat;
+            MeshCacheMaterial material = MeshCacheMaterial();
+            material.size = MISSING_FILE_SIZE;
+            if (stat(materialPath.c_str(), &materialStat) == 0)
+            {
+                material.mtime = modificationTime(materialStat);
+                material.size = materialStat.st_size;
+                material.hash = hashFile(materialPath);
+            }
+            materials.push_back(material);
+        }
+
+        MeshCacheHeader header = MeshCacheHeader();
+        memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = data.meshes.size();
+        header.textureCount = data.textures.size();
+        header.clusterTriangles = clusterTriangles;
+        header.materialCount = materials.size();
+        header.sourceMtime = modificationTime(st);
+        header.sourceSize = st.st_size;
+        header.sourceHash = hashFile(sourcePath);
+
+        // lay out the sections
+        size_t lodCount = 0;
+        for (const MeshData &mesh : data.meshes)
+            lodCount += mesh.lods.size();
+        uint64_t offset = sizeof(MeshCacheHeader) + data.meshes.size() * sizeof(MeshCacheEntry)
+                          + data.textures.size() * sizeof(MeshCacheTexture) + materials.size() * sizeof(MeshCacheMaterial)
+                          + lodCount * sizeof(MeshCacheLod);
+        vector<MeshCacheEntry> entries(data.meshes.size());
+        for (size_t i = 0; i < data.meshes.size(); i++)
+        {
+            entries[i].vertexCount = data.meshes[i].vertices.size();
+            entries[i].indexCount = data.meshes[i].indices.size();
+            entries[i].textureCount = data.meshes[i].textures.size();
+            entries[i].lodCount = data.meshes[i].lods.size();
+            entries[i].bounds = data.meshes[i].bounds;
+            entries[i].textureOffset = offset;
+            offset += entries[i].textureCount * sizeof(uint32_t);
+        }
+
+        string strings;
+        vector<MeshCacheTexture> textures(data.textures.size());
+        for (size_t i = 0; i < data.textures.size(); i++)
+        {
+            textures[i].typeOffset = offset + strings.size();
+            textures[i].typeLength = data.textures[i].type.size();
+            strings += data.textures[i].type;
+            textures[i].pathOffset = offset + strings.size();
+            textures[i].pathLength = data.textures[i].path.size();
+            strings += data.textures[i].path;
+        }
+        for (size_t i = 0; i < materials.size(); i++)
+        {
+            materials[i].pathOffset = offset + strings.size();
+            materials[i].pathLength = materialPaths[i].size();
+            strings += materialPaths[i];
+        }
+        offset = align(offset + strings.size());
+
+        for (size_t i = 0; i < data.meshes.size(); i++)
+        {
+            entries[i].vertexOffset = offset;
+            offset = align(offset + entries[i].vertexCount * sizeof(Vertex));
+        }
+        vector<MeshCacheLod> lods;
+        for (size_t i = 0; i < data.meshes.size(); i++)
+        {
+            entries[i].indexOffset = offset;
+            offset = align(offset + entries[i].indexCount * sizeof(uint32_t));
+            for (const MeshLod &lod : data.meshes[i].lods)
+            {
+                lods.push_back(MeshCacheLod{(uint32_t)lod.indices.size(), lod.error, offset});
+                offset = align(offset + lod.indices.size() * sizeof(uint32_t));
+            }
+        }
+
+        // write to a temporary file first so an interrupted write never leaves a broken cache behind
+        string path = cachePath(sourcePath);
+        string tmpPath = path + ".tmp";
+        {
+            ofstream out(tmpPath, ios::binary | ios::trunc);
+            if (!out)
+                return false;
+            out.write((const char *)&header, sizeof(header));
+            out.write((const char *)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+            out.write((const char *)textures.data(), textures.size() * sizeof(MeshCacheTexture));
+            out.write((const char *)materials.data(), materials.size() * sizeof(MeshCacheMaterial));
+            out.write((const char *)lods.data(), lods.size() * sizeof(MeshCacheLod));
+            for (const MeshData &mesh : data.meshes)
+                out.write((const char *)mesh.textures.data(), mesh.textures.size() * sizeof(uint32_t));
+            out.write(strings.data(), strings.size());
+            pad(out);
+            for (const MeshData &mesh : data.meshes)
+            {
+                out.write((const char *)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+                pad(out);
+            }
+            for (const MeshData &mesh : data.meshes)
+            {
+                out.write((const char *)mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+                pad(out);
+                for (const MeshLod &lod : mesh.lods)
+                {
+                    out.write((const char *)lod.indices.data(), lod.indices.size() * sizeof(uint32_t));
+                    pad(out);
+                }
+            }
+            if (!out)
+                return false;
+        }
+        if (rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static const uint64_t MISSING_FILE_SIZE = ~(uint64_t)0; // recorded for a material library that did not exist
+
+    // whether path still has the content recorded as mtime, size and hash. With only the mtime
+    // changed the file is hashed; on a match mtime takes the new value and touched is set.
+    static bool unchanged(const string &path, int64_t &mtime, uint64_t size, uint64_t hash, bool &touched)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return size == MISSING_FILE_SIZE;
+        if ((uint64_t)st.st_size != size)
+            return false;
+        if (modificationTime(st) == mtime)
+            return true;
+        if (hashFile(path) != hash)
+            return false;
+        mtime = modificationTime(st);
+        touched = true;
+        return true;
+    }
+
+    // the files of the mtllib statements of an .obj, relative to its directory; none for other formats
+    static vector<string> materialLibraries(const string &sourcePath)
+    {
+        vector<string> paths;
+        size_t extension = sourcePath.rfind('.');
+        if (extension == string::npos || sourcePath.compare(extension, string::npos, ".obj") != 0)
+            return paths;
+        size_t slash = sourcePath.find_last_of('/');
+        string directory = slash == string::npos ? "" : sourcePath.substr(0, slash + 1);
+        ifstream in(sourcePath);
+        string line;
+        while (getline(in, line))
+        {
+            if (line.compare(0, 7, "mtllib ") != 0)
+                continue;
+            size_t begin = line.find_first_not_of(" \t", 7);
+            size_t end = line.find_last_not_of(" \t\r");
+            if (begin != string::npos)
+                paths.push_back(directory + line.substr(begin, end - begin + 1));
+        }
+        return paths;
+    }
+
+    // nanosecond resolution, so an edit within the same second as the cache write is still noticed
+    static int64_t modificationTime(const struct stat &st)
+    {
+#ifdef __APPLE__
+        return (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t)15;
+    }
+
+    static void pad(ofstream &out)
+    {
+        static const char zeros[16] = {};
+        uint64_t position = out.tellp();
+        out.write(zeros, align(position) - position);
+    }
+
+    static bool inBounds(const MappedFile &file, uint64_t offset, uint64_t length)
+    {
+        return offset <= file.size && length <= file.size - offset;
+    }
+};
+#endif
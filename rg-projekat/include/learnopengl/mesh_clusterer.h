@@ -0,0 +1,92 @@
+#ifndef MESH_CLUSTERER_H
+#define MESH_CLUSTERER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/mesh_cache.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// Import time split of large static meshes into spatially compact clusters, run by Model before
+// MeshOptimizer for models declared clustered in the scene file. A mesh like the village's
+// ground, which spans the whole street, is otherwise always partly in view and never culled.
+//
+// The clusters are the leaves of a Bvh over the mesh's triangles with at most maxTriangles per
+// leaf, so they follow the SAH splits; every cluster becomes a mesh of its own with the same
+// textures, its own copy of the vertices it uses and its own bounds.
+class MeshClusterer {
+public:
+    // splits every mesh with more than maxTriangles triangles, returns the mesh count afterwards
+    static size_t Split(ModelData &data, unsigned int maxTriangles)
+    {
+        if (maxTriangles == 0)
+            return data.meshes.size();
+        vector<MeshData> meshes;
+        for (MeshData &mesh : data.meshes)
+        {
+            if (mesh.indices.size() / 3 <= maxTriangles)
+            {
+                meshes.push_back(std::move(mesh));
+                continue;
+            }
+            for (MeshData &cluster : splitMesh(mesh, maxTriangles))
+                meshes.push_back(std::move(cluster));
+        }
+        data.meshes = std::move(meshes);
+        return data.meshes.size();
+    }
+
+private:
+    static vector<MeshData> splitMesh(const MeshData &mesh, unsigned int maxTriangles)
+    {
+        size_t triangleCount = mesh.indices.size() / 3;
+        vector<MeshBounds> boxes(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3 &a = mesh.vertices[mesh.indices[3 * t]].Position;
+            const glm::vec3 &b = mesh.vertices[mesh.indices[3 * t + 1]].Position;
+            const glm::vec3 &c = mesh.vertices[mesh.indices[3 * t + 2]].Position;
+            boxes[t].min = glm::min(a, glm::min(b, c));
+            boxes[t].max = glm::max(a, glm::max(b, c));
+        }
+        Bvh bvh;
+        bvh.Build(boxes, maxTriangles);
+
+        vector<MeshData> clusters;
+        vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+        for (const BvhNode &node : bvh.nodes)
+        {
+            if (node.count == 0)
+                continue;
+            MeshData cluster;
+            cluster.textures = mesh.textures;
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                uint32_t t = bvh.primitives[i];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t vertex = mesh.indices[3 * t + corner];
+                    if (remap[vertex] == UINT32_MAX)
+                    {
+                        remap[vertex] = cluster.vertices.size();
+                        cluster.vertices.push_back(mesh.vertices[vertex]);
+                    }
+                    cluster.indices.push_back(remap[vertex]);
+                }
+            }
+            // only this cluster's vertices were remapped, reset just those
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+                for (int corner = 0; corner < 3; corner++)
+                    remap[mesh.indices[3 * bvh.primitives[i] + corner]] = UINT32_MAX;
+            cluster.bounds = MeshBounds::FromVertices(cluster.vertices);
+            clusters.push_back(std::move(cluster));
+        }
+        return clusters;
+    }
+};
+#endif
@@ -0,0 +1,287 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh_cache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+// post-transform vertex cache behaviour of an index buffer, see MeshOptimizer::AnalyzeVertexCache
+struct VertexCacheStats {
+    size_t misses = 0;
+    float acmr = 0.0f; // average cache miss ratio: transformed vertices per triangle, 0.5 at best, 3 at worst
+    float atvr = 0.0f; // average transform to vertex ratio: transformed vertices per vertex, 1 at best
+};
+
+// Import time reordering of a mesh for the GPU, run by Model before the mesh cache is written:
+//
+//  1. triangles for the post-transform vertex cache (Forsyth's linear speed optimizer)
+//  2. runs of those triangles for overdraw, outward facing clusters first (Sander et al.),
+//     kept only while the cache miss ratio stays within OVERDRAW_THRESHOLD of step 1
+//  3. vertices in the order the triangles first use them, for vertex fetch locality
+//
+// The triangles and vertices stay the same, only their order changes.
+class MeshOptimizer {
+public:
+    static const unsigned int CACHE_SIZE = 32;     // LRU size the Forsyth scores model
+    static const unsigned int FIFO_CACHE_SIZE = 16; // FIFO used to find cluster boundaries
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    static void Optimize(MeshData &mesh)
+    {
+        if (mesh.indices.size() < 3 || mesh.indices.size() % 3 != 0)
+            return;
+        OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+        OptimizeOverdraw(mesh.indices, mesh.vertices);
+        OptimizeVertexFetch(mesh.indices, mesh.vertices);
+    }
+
+    // Simulates a FIFO post-transform cache of cacheSize entries over the triangle list, the model
+    // of most desktop GPUs. Needs no GL.
+    static VertexCacheStats AnalyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount,
+                                               unsigned int cacheSize = FIFO_CACHE_SIZE)
+    {
+        VertexCacheStats stats;
+        vector<size_t> cachedAt(vertexCount, 0); // miss counter value when the vertex entered the cache
+        for (unsigned int index : indices)
+        {
+            if (cachedAt[index] == 0 || stats.misses + 1 - cachedAt[index] > cacheSize)
+            {
+                stats.misses++;
+                cachedAt[index] = stats.misses;
+            }
+        }
+        if (!indices.empty())
+            stats.acmr = (float)stats.misses / (indices.size() / 3);
+        if (vertexCount)
+            stats.atvr = (float)stats.misses / vertexCount;
+        return stats;
+    }
+
+    // Forsyth, "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle with the highest
+    // score, where vertices score for being recently used and for having few triangles left
+    static void OptimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+
+        // triangles of every vertex, as offsets into one array
+        vector<unsigned int> triangleOffsets(vertexCount + 1, 0);
+        for (unsigned int index : indices)
+            triangleOffsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        vector<unsigned int> vertexTriangles(indices.size());
+        vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            vertexTriangles[fill[indices[i]]++] = i / 3;
+
+        vector<unsigned int> remaining(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            remaining[v] = triangleOffsets[v + 1] - triangleOffsets[v];
+        vector<int> cachePosition(vertexCount, -1);
+        vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = score(-1, remaining[v]);
+
+        vector<bool> emitted(triangleCount, false);
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        vector<unsigned int> cache, nextCache;
+        size_t scanCursor = 0; // triangles before it are all emitted
+        long best = -1;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+        {
+            if (best < 0)
+            {
+                // nothing in the cache to continue with, start over at the next triangle in input
+                // order. Searching for the best score here would make meshes with many disconnected
+                // pieces quadratic.
+                while (emitted[scanCursor])
+                    scanCursor++;
+                best = scanCursor;
+            }
+
+            emitted[best] = true;
+            nextCache.clear();
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int v = indices[3 * best + corner];
+                result.push_back(v);
+                nextCache.push_back(v);
+                remaining[v]--;
+                // drop the triangle from the vertex's list so scores only see what is left
+                unsigned int *first = &vertexTriangles[triangleOffsets[v]];
+                unsigned int *last = first + remaining[v];
+                for (unsigned int *t = first; t <= last; t++)
+                    if (*t == (unsigned int)best)
+                    {
+                        swap(*t, *last);
+                        break;
+                    }
+            }
+            for (unsigned int v : cache)
+                if (nextCache.size() >= CACHE_SIZE + 3)
+                    break;
+                else if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+                    nextCache.push_back(v);
+            // vertices pushed out of the cache lose their position score
+            for (unsigned int v : cache)
+                cachePosition[v] = -1;
+            swap(cache, nextCache);
+            for (size_t i = 0; i < cache.size(); i++)
+                cachePosition[cache[i]] = i < CACHE_SIZE ? (int)i : -1;
+
+            // rescore the vertices in the cache and those that just fell out, then pick the best
+            // triangle touching the cache
+            for (unsigned int v : nextCache)
+                vertexScore[v] = score(cachePosition[v], remaining[v]);
+            for (unsigned int v : cache)
+                vertexScore[v] = score(cachePosition[v], remaining[v]);
+            best = -1;
+            float bestScore = -1.0f;
+            for (unsigned int v : cache)
+                for (unsigned int i = 0; i < remaining[v]; i++)
+                {
+                    unsigned int t = vertexTriangles[triangleOffsets[v] + i];
+                    float triangleScore = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]]
+                                          + vertexScore[indices[3 * t + 2]];
+                    if (triangleScore > bestScore)
+                    {
+                        bestScore = triangleScore;
+                        best = t;
+                    }
+                }
+        }
+        indices.swap(result);
+    }
+
+    // Splits the cache optimized triangles into clusters where the FIFO cache starts cold (all
+    // three vertices miss) and draws the clusters facing away from the mesh center first, so
+    // outer surfaces tend to cover inner ones early. Reverted if it costs too many cache misses.
+    static void OptimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices)
+    {
+        size_t triangleCount = indices.size() / 3;
+        VertexCacheStats before = AnalyzeVertexCache(indices, vertices.size());
+
+        vector<size_t> clusterStarts;
+        {
+            vector<size_t> cachedAt(vertices.size(), 0);
+            size_t misses = 0;
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                int triangleMisses = 0;
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    unsigned int index = indices[3 * t + corner];
+                    if (cachedAt[index] == 0 || misses + 1 - cachedAt[index] > FIFO_CACHE_SIZE)
+                    {
+                        misses++;
+                        cachedAt[index] = misses;
+                        triangleMisses++;
+                    }
+                }
+                if (t == 0 || triangleMisses == 3)
+                    clusterStarts.push_back(t);
+            }
+        }
+        if (clusterStarts.size() < 2)
+            return;
+
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        struct Cluster {
+            size_t start, end;
+            float sortKey;
+        };
+        vector<Cluster> clusters;
+        vector<glm::vec3> clusterCenters;
+        vector<glm::vec3> clusterNormals;
+        for (size_t c = 0; c < clusterStarts.size(); c++)
+        {
+            size_t start = clusterStarts[c];
+            size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = start; t < end; t++)
+            {
+                const glm::vec3 &a = vertices[indices[3 * t]].Position;
+                const glm::vec3 &b = vertices[indices[3 * t + 1]].Position;
+                const glm::vec3 &d = vertices[indices[3 * t + 2]].Position;
+                glm::vec3 cross = glm::cross(b - a, d - a); // length is twice the area
+                float triangleArea = glm::length(cross);
+                center += (a + b + d) * (triangleArea / 3.0f);
+                normal += cross;
+                area += triangleArea;
+            }
+            meshCenter += center;
+            meshArea += area;
+            clusters.push_back(Cluster{start, end, 0.0f});
+            clusterCenters.push_back(area > 0.0f ? center / area : vertices[indices[3 * start]].Position);
+            clusterNormals.push_back(normal);
+        }
+        if (meshArea > 0.0f)
+            meshCenter /= meshArea;
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            float length = glm::length(clusterNormals[c]);
+            clusters[c].sortKey = length > 0.0f ? glm::dot(clusterCenters[c] - meshCenter, clusterNormals[c] / length) : 0.0f;
+        }
+        stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+        vector<unsigned int> sorted;
+        sorted.reserve(indices.size());
+        for (const Cluster &cluster : clusters)
+            sorted.insert(sorted.end(), indices.begin() + 3 * cluster.start, indices.begin() + 3 * cluster.end);
+        if (AnalyzeVertexCache(sorted, vertices.size()).acmr <= before.acmr * OVERDRAW_THRESHOLD)
+            indices.swap(sorted);
+    }
+
+    // renumbers the vertices in the order the index buffer first references them, unreferenced ones last
+    static void OptimizeVertexFetch(vector<unsigned int> &indices, vector<Vertex> &vertices)
+    {
+        const unsigned int UNUSED = ~0u;
+        vector<unsigned int> remap(vertices.size(), UNUSED);
+        vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (unsigned int &index : indices)
+        {
+            if (remap[index] == UNUSED)
+            {
+                remap[index] = reordered.size();
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        for (size_t v = 0; v < vertices.size(); v++)
+            if (remap[v] == UNUSED)
+                reordered.push_back(vertices[v]);
+        vertices.swap(reordered);
+    }
+
+private:
+    // Forsyth's vertex score: the last triangle's vertices get a fixed score (so the optimizer does
+    // not simply strip), older entries decay with their position, and vertices with few remaining
+    // triangles get a boost so they are finished off instead of leaving lone triangles behind
+    static float score(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+        float result = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                result = 0.75f;
+            else
+                result = std::pow(1.0f - (float)(cachePosition - 3) / (CACHE_SIZE - 3), 1.5f);
+        }
+        return result + 2.0f / std::sqrt((float)remainingTriangles);
+    }
+};
+#endif
@@ -0,0 +1,520 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// Import time level of detail generation, run by Model after MeshOptimizer and stored in the mesh
+// cache. Every level is a new index buffer over the mesh's vertices: edges are collapsed onto one
+// of their endpoints (Garland and Heckbert's quadric error metric picks which), so vertex
+// attributes never need interpolating and all levels share one vertex buffer.
+//
+// Vertices on UV or normal seams (several vertices at one position) and on open edges that do
+// not continue a border stay put, so texture charts and the outlines of the car's separate
+// parts keep their shape; border vertices only slide along their border.
+class MeshSimplifier {
+public:
+    static const unsigned int LOD_LEVELS = 4;       // including the full mesh
+    static constexpr float LOD_RATIO = 0.5f;        // triangles of a level relative to the one before
+    static constexpr float MIN_REDUCTION = 0.8f;    // a level has to get below this share of the one before
+    static constexpr float MAX_ERROR = 0.05f;       // largest collapse error, relative to the bounding radius
+    static const size_t MIN_TRIANGLES = 64;         // smaller meshes are not worth a level of their own
+
+    // fills mesh.lods with up to LOD_LEVELS - 1 coarser levels of mesh.indices
+    static void GenerateLods(MeshData &mesh)
+    {
+        mesh.lods.clear();
+        if (mesh.indices.size() < 3 * MIN_TRIANGLES || mesh.indices.size() % 3 != 0)
+            return;
+        size_t target = mesh.indices.size();
+        size_t previous = mesh.indices.size();
+        float previousError = 0.0f;
+        for (unsigned int level = 1; level < LOD_LEVELS; level++)
+        {
+            target = (size_t)(target * LOD_RATIO) / 3 * 3;
+            float error = 0.0f;
+            // always from the full mesh, so the error is measured against the original surface
+            vector<unsigned int> indices = Simplify(mesh.vertices, mesh.indices, target,
+                                                    MAX_ERROR * mesh.bounds.radius, &error);
+            if (indices.empty() || indices.size() > previous * MIN_REDUCTION)
+                break;
+            MeshOptimizer::OptimizeVertexCache(indices, mesh.vertices.size());
+            previous = indices.size();
+            previousError = std::max(previousError, error);
+            mesh.lods.push_back(MeshLod{std::move(indices), previousError});
+        }
+    }
+
+    // Appends a positions only copy of mesh for occlusion culling: the vertices welded by position,
+    // so UV and normal seams no longer lock anything, and simplified as far as maxError (model
+    // units) allows. Only convex vertices collapse (see convexStar), so the copy lies inside the
+    // original surface and never hides anything the original would not.
+    static void SimplifyOccluder(const MeshData &mesh, float maxError, vector<glm::vec3> &positions,
+                                 vector<unsigned int> &indices)
+    {
+        vector<unsigned int> position = weldPositions(mesh.vertices);
+        vector<unsigned int> remap(mesh.vertices.size(), UINT32_MAX);
+        vector<Vertex> welded;
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+            if (position[i] == i)
+            {
+                remap[i] = welded.size();
+                Vertex vertex = Vertex();
+                vertex.Position = mesh.vertices[i].Position;
+                welded.push_back(vertex);
+            }
+        vector<unsigned int> weldedIndices;
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+        {
+            unsigned int a = remap[position[mesh.indices[t]]], b = remap[position[mesh.indices[t + 1]]];
+            unsigned int c = remap[position[mesh.indices[t + 2]]];
+            if (a == b || b == c || a == c)
+                continue;
+            weldedIndices.push_back(a);
+            weldedIndices.push_back(b);
+            weldedIndices.push_back(c);
+        }
+        if (weldedIndices.size() >= 3 * MIN_TRIANGLES)
+            weldedIndices = Simplify(welded, weldedIndices, 0, maxError, nullptr, true);
+
+        // only the vertices the simplified triangles still use
+        std::fill(remap.begin(), remap.end(), UINT32_MAX);
+        for (unsigned int index : weldedIndices)
+        {
+            if (remap[index] == UINT32_MAX)
+            {
+                remap[index] = positions.size();
+                positions.push_back(welded[index].Position);
+            }
+            indices.push_back(remap[index]);
+        }
+    }
+
+    // Collapses edges of the triangle list until at most targetIndexCount indices are left or
+    // every remaining collapse would move the surface further than maxError. Returns the new
+    // indices; error receives the largest collapse error, a distance in model units. Conservative
+    // simplification only collapses vertices whose collapse cuts into the surface.
+    static vector<unsigned int> Simplify(const vector<Vertex> &vertices, const vector<unsigned int> &source,
+                                         size_t targetIndexCount, float maxError, float *error = nullptr,
+                                         bool conservative = false)
+    {
+        size_t vertexCount = vertices.size();
+        vector<unsigned int> indices = source;
+        float resultError = 0.0f;
+
+        vector<unsigned int> position = weldPositions(vertices);
+        vector<unsigned int> borderNext, borderPrevious;
+        vector<unsigned char> kind = classify(vertices, indices, position, borderNext, borderPrevious);
+        vector<Quadric> quadrics = computeQuadrics(vertices, indices, position);
+
+        vector<unsigned int> triangleOffsets, vertexTriangles;
+        vector<Collapse> collapses;
+        vector<unsigned char> touched(vertexCount);
+        const double errorLimit = (double)maxError * maxError;
+
+        while (indices.size() > targetIndexCount)
+        {
+            buildAdjacency(indices, vertexCount, triangleOffsets, vertexTriangles);
+
+            // cheapest valid collapse of every vertex
+            collapses.clear();
+            for (unsigned int v = 0; v < vertexCount; v++)
+            {
+                if (kind[v] == KIND_LOCKED || triangleOffsets[v] == triangleOffsets[v + 1])
+                    continue;
+                if (conservative && !convexStar(v, vertices, indices, position, kind, borderNext, borderPrevious,
+                                                triangleOffsets, vertexTriangles))
+                    continue;
+                Collapse best = Collapse{v, v, 0.0};
+                for (unsigned int i = triangleOffsets[v]; i < triangleOffsets[v + 1]; i++)
+                {
+                    unsigned int t = vertexTriangles[i];
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        unsigned int w = indices[3 * t + corner];
+                        if (position[w] == position[v] || !canCollapse(v, w, kind, position, borderNext, borderPrevious))
+                            continue;
+                        Quadric q = quadrics[position[v]];
+                        q.add(quadrics[position[w]]);
+                        double cost = q.evaluate(vertices[w].Position);
+                        if (best.to == v || cost < best.error)
+                            best = Collapse{v, w, cost};
+                    }
+                }
+                if (best.to != v && best.error <= errorLimit)
+                    collapses.push_back(best);
+            }
+            if (collapses.empty())
+                break;
+            sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+            // collapses costing far more than the cheap ones wait for the next pass, which sees
+            // the mesh they left behind
+            double passLimit = std::max(collapses[collapses.size() / 4].error * 1.5, 1e-12);
+            size_t trianglesToRemove = (indices.size() - targetIndexCount) / 3;
+            size_t removed = 0, done = 0;
+            fill(touched.begin(), touched.end(), 0);
+            for (const Collapse &collapse : collapses)
+            {
+                if (removed >= trianglesToRemove || (collapse.error > passLimit && done > 0))
+                    break;
+                unsigned int v = collapse.from, w = collapse.to;
+                if (touched[v] || touched[w] || flips(v, w, vertices, indices, position, triangleOffsets, vertexTriangles))
+                    continue;
+
+                // neighbours of v see it move, so they wait for the next pass as well
+                for (unsigned int i = triangleOffsets[v]; i < triangleOffsets[v + 1]; i++)
+                {
+                    unsigned int t = vertexTriangles[i];
+                    bool degenerate = false;
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        unsigned int &index = indices[3 * t + corner];
+                        touched[index] = 1;
+                        degenerate |= position[index] == position[w];
+                        if (index == v)
+                            index = w;
+                    }
+                    removed += degenerate;
+                }
+                touched[w] = 1;
+                quadrics[position[w]].add(quadrics[position[v]]);
+                if (kind[v] == KIND_BORDER)
+                    unlinkBorder(position[v], position[w], borderNext, borderPrevious);
+                resultError = std::max(resultError, (float)std::sqrt(std::max(collapse.error, 0.0)));
+                done++;
+            }
+            if (done == 0)
+                break;
+            removeDegenerate(indices, position);
+        }
+
+        if (error)
+            *error = resultError;
+        return indices;
+    }
+
+private:
+    enum VertexKind : unsigned char {
+        KIND_MANIFOLD, // inside a closed surface, may collapse onto any neighbour
+        KIND_BORDER,   // on one open border, may only slide along it
+        KIND_LOCKED    // seam, corner or non-manifold, never moves
+    };
+
+    struct Collapse {
+        unsigned int from, to;
+        double error;
+    };
+
+    // symmetric 4x4 quadric of Garland and Heckbert, area weighted. evaluate divides by the weight,
+    // so the error is a mean squared distance to the planes the vertex has absorbed.
+    struct Quadric {
+        double a00 = 0, a11 = 0, a22 = 0, a10 = 0, a20 = 0, a21 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0, weight = 0;
+
+        static Quadric plane(const glm::vec3 &normal, double distance, double weight)
+        {
+            Quadric q;
+            double nx = normal.x, ny = normal.y, nz = normal.z;
+            q.a00 = weight * nx * nx;
+            q.a11 = weight * ny * ny;
+            q.a22 = weight * nz * nz;
+            q.a10 = weight * ny * nx;
+            q.a20 = weight * nz * nx;
+            q.a21 = weight * nz * ny;
+            q.b0 = weight * nx * distance;
+            q.b1 = weight * ny * distance;
+            q.b2 = weight * nz * distance;
+            q.c = weight * distance * distance;
+            q.weight = weight;
+            return q;
+        }
+
+        void add(const Quadric &o)
+        {
+            a00 += o.a00; a11 += o.a11; a22 += o.a22;
+            a10 += o.a10; a20 += o.a20; a21 += o.a21;
+            b0 += o.b0; b1 += o.b1; b2 += o.b2;
+            c += o.c;
+            weight += o.weight;
+        }
+
+        double evaluate(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double r = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a10 * x * y + a20 * x * z + a21 * y * z)
+                       + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0.0 ? std::fabs(r) / weight : 0.0;
+        }
+    };
+
+    // first vertex at the same position, for every vertex
+    static vector<unsigned int> weldPositions(const vector<Vertex> &vertices)
+    {
+        vector<unsigned int> order(vertices.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        auto less = [&](unsigned int a, unsigned int b) {
+            const glm::vec3 &p = vertices[a].Position, &q = vertices[b].Position;
+            if (p.x != q.x)
+                return p.x < q.x;
+            if (p.y != q.y)
+                return p.y < q.y;
+            if (p.z != q.z)
+                return p.z < q.z;
+            return a < b;
+        };
+        sort(order.begin(), order.end(), less);
+        vector<unsigned int> position(vertices.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            bool same = i > 0 && vertices[order[i]].Position == vertices[order[i - 1]].Position;
+            position[order[i]] = same ? position[order[i - 1]] : order[i];
+        }
+        return position;
+    }
+
+    static uint64_t edgeKey(unsigned int a, unsigned int b)
+    {
+        return ((uint64_t)a << 32) | b;
+    }
+
+    // directed edges between positions, an edge is open if its reverse is missing
+    static unordered_set<uint64_t> directedEdges(const vector<unsigned int> &indices, const vector<unsigned int> &position)
+    {
+        unordered_set<uint64_t> edges;
+        edges.reserve(indices.size());
+        for (size_t t = 0; t < indices.size(); t += 3)
+            for (int corner = 0; corner < 3; corner++)
+                edges.insert(edgeKey(position[indices[t + corner]], position[indices[t + (corner + 1) % 3]]));
+        return edges;
+    }
+
+    // kind of every vertex, and for border positions their neighbours along the border
+    static vector<unsigned char> classify(const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+                                          const vector<unsigned int> &position, vector<unsigned int> &borderNext,
+                                          vector<unsigned int> &borderPrevious)
+    {
+        vector<unsigned int> copies(vertices.size(), 0);
+        for (size_t v = 0; v < vertices.size(); v++)
+            copies[position[v]]++;
+        unordered_set<uint64_t> edges = directedEdges(indices, position);
+        vector<unsigned int> openOut(vertices.size(), 0), openIn(vertices.size(), 0);
+        borderNext.assign(vertices.size(), ~0u);
+        borderPrevious.assign(vertices.size(), ~0u);
+        for (size_t t = 0; t < indices.size(); t += 3)
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int a = position[indices[t + corner]], b = position[indices[t + (corner + 1) % 3]];
+                if (!edges.count(edgeKey(b, a)))
+                {
+                    openOut[a]++;
+                    openIn[b]++;
+                    borderNext[a] = b;
+                    borderPrevious[b] = a;
+                }
+            }
+        vector<unsigned char> kind(vertices.size(), KIND_LOCKED);
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            unsigned int p = position[v];
+            if (copies[p] != 1)
+                continue;
+            if (openOut[p] == 0 && openIn[p] == 0)
+                kind[v] = KIND_MANIFOLD;
+            else if (openOut[p] == 1 && openIn[p] == 1)
+                kind[v] = KIND_BORDER;
+        }
+        return kind;
+    }
+
+    // plane quadrics of every triangle, plus planes through the open edges perpendicular to the
+    // surface so borders resist moving sideways
+    static vector<Quadric> computeQuadrics(const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+                                           const vector<unsigned int> &position)
+    {
+        const double BORDER_WEIGHT = 10.0;
+        vector<Quadric> quadrics(vertices.size());
+        unordered_set<uint64_t> edges = directedEdges(indices, position);
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            const glm::vec3 &a = vertices[indices[t]].Position;
+            const glm::vec3 &b = vertices[indices[t + 1]].Position;
+            const glm::vec3 &c = vertices[indices[t + 2]].Position;
+            glm::vec3 cross = glm::cross(b - a, c - a);
+            float length = glm::length(cross);
+            if (length <= 0.0f)
+                continue;
+            glm::vec3 normal = cross / length;
+            Quadric q = Quadric::plane(normal, -glm::dot(normal, a), length * 0.5);
+            for (int corner = 0; corner < 3; corner++)
+                quadrics[position[indices[t + corner]]].add(q);
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int i0 = indices[t + corner], i1 = indices[t + (corner + 1) % 3];
+                if (edges.count(edgeKey(position[i1], position[i0])))
+                    continue;
+                glm::vec3 edge = vertices[i1].Position - vertices[i0].Position;
+                float edgeLength = glm::length(edge);
+                if (edgeLength <= 0.0f)
+                    continue;
+                glm::vec3 side = glm::normalize(glm::cross(edge, normal));
+                Quadric border = Quadric::plane(side, -glm::dot(side, vertices[i0].Position),
+                                                BORDER_WEIGHT * edgeLength * edgeLength);
+                quadrics[position[i0]].add(border);
+                quadrics[position[i1]].add(border);
+            }
+        }
+        return quadrics;
+    }
+
+    // triangles of every vertex, as offsets into one array
+    static void buildAdjacency(const vector<unsigned int> &indices, size_t vertexCount, vector<unsigned int> &offsets,
+                               vector<unsigned int> &triangles)
+    {
+        offsets.assign(vertexCount + 1, 0);
+        for (unsigned int index : indices)
+            offsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        triangles.resize(indices.size());
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            triangles[fill[indices[i]]++] = i / 3;
+    }
+
+    // border vertices only collapse onto a neighbour along their border
+    static bool canCollapse(unsigned int v, unsigned int w, const vector<unsigned char> &kind,
+                            const vector<unsigned int> &position, const vector<unsigned int> &borderNext,
+                            const vector<unsigned int> &borderPrevious)
+    {
+        if (kind[v] == KIND_MANIFOLD)
+            return true;
+        return kind[v] == KIND_BORDER
+               && (position[w] == borderNext[position[v]] || position[w] == borderPrevious[position[v]]);
+    }
+
+    // border position v collapsed onto its border neighbour w, so v's other neighbour links to w
+    static void unlinkBorder(unsigned int v, unsigned int w, vector<unsigned int> &borderNext,
+                             vector<unsigned int> &borderPrevious)
+    {
+        if (w == borderNext[v])
+        {
+            unsigned int previous = borderPrevious[v];
+            borderNext[previous] = w;
+            borderPrevious[w] = previous;
+        }
+        else
+        {
+            unsigned int next = borderNext[v];
+            borderPrevious[next] = w;
+            borderNext[w] = next;
+        }
+    }
+
+    // would moving v onto w turn any of v's remaining triangles over (or nearly so)
+    static bool flips(unsigned int v, unsigned int w, const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+                      const vector<unsigned int> &position, const vector<unsigned int> &offsets,
+                      const vector<unsigned int> &triangles)
+    {
+        const glm::vec3 &target = vertices[w].Position;
+        for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+        {
+            unsigned int t = triangles[i];
+            glm::vec3 corners[3], moved[3];
+            bool collapses = false;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int index = indices[3 * t + corner];
+                collapses |= index != v && position[index] == position[w];
+                corners[corner] = vertices[index].Position;
+                moved[corner] = index == v ? target : corners[corner];
+            }
+            if (collapses)
+                continue;
+            glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                return true;
+        }
+        return false;
+    }
+
+    // Whether every neighbour of v lies on or behind the planes of v's triangles and, for a border
+    // vertex, behind the planes through its two open edges perpendicular to the surface. The star
+    // of v is convex then, and the fan that replaces it after collapsing v onto any neighbour lies
+    // within it: the surface only moves inwards and its outline only shrinks. Neighbours that
+    // collapse in the same pass touch v, so its star is still the one tested when it collapses.
+    static bool convexStar(unsigned int v, const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+                           const vector<unsigned int> &position, const vector<unsigned char> &kind,
+                           const vector<unsigned int> &borderNext, const vector<unsigned int> &borderPrevious,
+                           const vector<unsigned int> &offsets, const vector<unsigned int> &triangles)
+    {
+        const float TOLERANCE = 1e-5f; // of the distance to the neighbour, float rounding of flat stars
+        const int MAX_PLANES = 64;     // busier vertices stay put
+        const glm::vec3 &origin = vertices[v].Position;
+        unsigned int p = position[v];
+        glm::vec3 planes[MAX_PLANES];
+        int planeCount = 0;
+        for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+        {
+            unsigned int t = triangles[i];
+            const glm::vec3 &a = vertices[indices[3 * t]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[3 * t + 1]].Position - a, vertices[indices[3 * t + 2]].Position - a);
+            float length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;
+            normal /= length;
+            if (planeCount + 3 > MAX_PLANES)
+                return false;
+            planes[planeCount++] = normal;
+            if (kind[v] != KIND_BORDER)
+                continue;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int i0 = indices[3 * t + corner], i1 = indices[3 * t + (corner + 1) % 3];
+                bool open = (position[i0] == p && position[i1] == borderNext[p])
+                            || (position[i0] == borderPrevious[p] && position[i1] == p);
+                if (open)
+                    planes[planeCount++] = glm::normalize(glm::cross(vertices[i1].Position - vertices[i0].Position, normal));
+            }
+        }
+        for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+            for (int corner = 0; corner < 3; corner++)
+            {
+                glm::vec3 offset = vertices[indices[3 * triangles[i] + corner]].Position - origin;
+                float limit = TOLERANCE * glm::length(offset);
+                for (int plane = 0; plane < planeCount; plane++)
+                    if (glm::dot(planes[plane], offset) > limit)
+                        return false;
+            }
+        return true;
+    }
+
+    static void removeDegenerate(vector<unsigned int> &indices, const vector<unsigned int> &position)
+    {
+        size_t write = 0;
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            unsigned int a = position[indices[t]], b = position[indices[t + 1]], c = position[indices[t + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            indices[write++] = indices[t];
+            indices[write++] = indices[t + 1];
+            indices[write++] = indices[t + 2];
+        }
+        indices.resize(write);
+    }
+};
+#endif
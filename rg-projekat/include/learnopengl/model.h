@@ -11,8 +11,15 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
-#include <learnopengl/shader.h>
-
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_clusterer.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/mesh_simplifier.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cstddef>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -23,6 +30,20 @@ using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// one copy of a model for Model::DrawInstanced, uploaded as is into the instance buffer
+struct ModelInstance {
+    glm::mat4 transform;
+    glm::vec3 tint = glm::vec3(1.0f); // multiplies the lit color
+    GLint pointLight = -1;            // for shaders lit by a single point light
+};
+static_assert(sizeof(ModelInstance) == 80, "ModelInstance layout");
+
+// locations of the per instance attributes, after the VertexAttribute ones
+enum InstanceAttribute {
+    INSTANCE_ATTRIBUTE_TRANSFORM = VERTEX_ATTRIBUTE_COUNT, // a mat4 takes four locations, one per column
+    INSTANCE_ATTRIBUTE_TINT = INSTANCE_ATTRIBUTE_TRANSFORM + 4,
+    INSTANCE_ATTRIBUTE_POINT_LIGHT
+};
 
 
 class Model
@@ -31,8 +52,25 @@ public:
     // model data
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    GeometryPool    geometry; // vertices and indices of all meshes
+    MeshBounds      bounds = MeshBounds(); // model space, around all meshes
     string directory;
     bool gammaCorrection;
+    VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT; // layout of the vertex buffers SetupMeshes creates
+    unsigned int vertexAttributes = VERTEX_ATTRIBUTES_ALL; // attributes they store, see Mesh
+    bool textureArrays = false; // SetupMeshes moves the textures into TextureArrays
+    unsigned int clusterTriangles = 0; // split meshes into clusters of at most this many triangles at import, see MeshClusterer
+    bool keepOccluderGeometry = false;  // SetupMeshes keeps a simplified copy of every mesh for SoftwareOcclusion
+    vector<glm::vec3> occluderPositions; // model space, of all meshes
+    vector<unsigned int> occluderIndices;
+    vector<unsigned int> arrays; // texture arrays owned by the model
+    // largest surface error of any mesh per level of detail, in model units; level 0 is the full model
+    vector<float> lodErrors = vector<float>(1, 0.0f);
+
+    // how many pixels a level of detail may move the surface before it is not used
+    static constexpr float LOD_PIXEL_ERROR = 1.0f;
+    // how far the occluder copy may move the surface, in model units (see MeshSimplifier::SimplifyOccluder)
+    static constexpr float OCCLUDER_MAX_ERROR = 0.05f;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -40,40 +78,285 @@ public:
         loadModel(path);
     }
 
+    // empty model, to be filled in by an AssetLoader
+    explicit Model(bool gamma = false) : gammaCorrection(gamma)
+    {
+    }
+
     // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    void Draw(Shader &shader, unsigned int lod = 0)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw(shader, lod);
+    }
+
+    // coarsest level of detail whose error stays under LOD_PIXEL_ERROR when one model unit covers
+    // pixelsPerUnit pixels on screen
+    unsigned int SelectLod(float pixelsPerUnit) const
+    {
+        for (unsigned int level = lodErrors.size() - 1; level > 0; level--)
+            if (lodErrors[level] * pixelsPerUnit <= LOD_PIXEL_ERROR)
+                return level;
+        return 0;
+    }
+
+    // Draws count copies of the model with one glDrawElementsInstanced call per mesh, however many
+    // there are. The instances go into a buffer of their own, read by the InstanceAttribute
+    // locations with a divisor of one; shader has to take its model matrix from there (the
+    // INSTANCED variant of model_loading.vs).
+    void DrawInstanced(Shader &shader, const ModelInstance *instances, unsigned int count, unsigned int lod = 0)
+    {
+        if (count == 0)
+            return;
+        uploadInstances(instances, count);
+        for (Mesh &mesh : meshes)
+            mesh.DrawInstanced(shader, count, lod);
+        FrameStats::Get().instances += count;
+    }
+
+    // DrawInstanced for the depth pre-pass, positions only (see Mesh::DrawInstancedDepth)
+    void DrawInstancedDepth(Shader &shader, GLint positionScaleLocation, GLint positionOffsetLocation,
+                            const ModelInstance *instances, unsigned int count, unsigned int lod = 0)
+    {
+        if (count == 0)
+            return;
+        uploadInstances(instances, count);
+        for (Mesh &mesh : meshes)
+            mesh.DrawInstancedDepth(shader, positionScaleLocation, positionOffsetLocation, count, lod);
+        FrameStats::Get().instances += count;
+    }
+
+    // drops this model's references in the TextureRegistry, textures no other model uses are freed
+    void ReleaseTextures()
+    {
+        if (arrays.empty())
+            for (const Texture &texture : textures_loaded)
+                TextureRegistry::Instance().Release(texture.id);
+        for (unsigned int array : arrays)
+            GLState::Get().DeleteTexture(array);
+        arrays.clear();
+        textures_loaded.clear();
+        for (Mesh &mesh : meshes)
+        {
+            mesh.textures.clear();
+            mesh.SetShaderTextureNamePrefix(mesh.glslIdentifierPrefix);
+        }
+    }
+
+    // frees the vertex, index and instance buffers, needs the GL context
+    void ReleaseBuffers()
+    {
+        geometry.Destroy();
+        if (instanceBuffer)
+            GLState::Get().DeleteBuffer(instanceBuffer);
+        instanceBuffer = 0;
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+            mesh.SetShaderTextureNamePrefix(prefix);
+        }
+    }
+
+    // fills data with the model at path, from the binary mesh cache when it is up to date and
+    // through ASSIMP otherwise (refreshing the cache). With clusterTriangles the imported meshes
+    // are first split by MeshClusterer. Imported meshes are then reordered by
+    // MeshOptimizer unless optimize is false, which also generates their levels of detail
+    // (MeshSimplifier); the cache only ever holds optimized meshes.
+    // Does not touch OpenGL, so it is safe to call without a context.
+    static bool LoadModelData(string const &path, ModelData &data, bool useCache = true, bool optimize = true,
+                              unsigned int clusterTriangles = 0)
+    {
+        useCache = useCache && optimize;
+        if (useCache && MeshCache::read(path, data, clusterTriangles))
+            return true;
+
+        data = ModelData();
+        if (!importModel(path, data))
+            return false;
+        if (clusterTriangles)
+        {
+            size_t meshCount = data.meshes.size();
+            MeshClusterer::Split(data, clusterTriangles);
+            cout << "CLUSTERS:: " << path << ": " << meshCount << " meshes split into " << data.meshes.size()
+                 << " clusters of at most " << clusterTriangles << " triangles" << endl;
         }
+        if (optimize)
+            for (MeshData &mesh : data.meshes)
+            {
+                MeshOptimizer::Optimize(mesh);
+                MeshSimplifier::GenerateLods(mesh);
+            }
+        if (useCache && !MeshCache::write(path, data, clusterTriangles))
+            cout << "WARNING::MESH_CACHE:: could not write " << MeshCache::cachePath(path) << endl;
+        return true;
+    }
+
+    // retrieve the directory path of the filepath
+    static string DirectoryOf(string const &path)
+    {
+        return path.substr(0, path.find_last_of('/'));
     }
+
+    // GL part of loading: creates the meshes of data in one geometry pool. textures_loaded must
+    // already hold the uploaded textures in the order of data.textures. With textureArrays they
+    // are copied into arrays and the 2D textures released.
+    void SetupMeshes(ModelData &data)
+    {
+        reportConstantTextures(data);
+
+        if (textureArrays && !textures_loaded.empty())
+        {
+            vector<unsigned int> ids;
+            for (const Texture &texture : textures_loaded)
+                ids.push_back(texture.id);
+            size_t bytes = 0;
+            arrays = TextureArrays::Build(textures_loaded, &bytes);
+            for (unsigned int id : ids)
+                TextureRegistry::Instance().Release(id);
+            cout << "TEXTURE_ARRAYS:: " << directory << ": " << textures_loaded.size() << " textures in " << arrays.size()
+                 << " arrays, " << bytes / (1024.0 * 1024.0) << " MB" << endl;
+        }
+
+        // packed positions are quantized to the bounds of the whole model
+        bounds = MeshBounds();
+        for (size_t i = 0; i < data.meshes.size(); i++)
+        {
+            bounds.min = i == 0 ? data.meshes[i].bounds.min : glm::min(bounds.min, data.meshes[i].bounds.min);
+            bounds.max = i == 0 ? data.meshes[i].bounds.max : glm::max(bounds.max, data.meshes[i].bounds.max);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        for (const MeshData &meshData : data.meshes)
+            bounds.radius = std::max(bounds.radius, glm::length(meshData.bounds.center - bounds.center) + meshData.bounds.radius);
+        geometry = GeometryPool(VertexLayout(vertexFormat, vertexAttributes), bounds);
+
+        occluderPositions.clear();
+        occluderIndices.clear();
+        for (MeshData &meshData : data.meshes)
+        {
+            if (keepOccluderGeometry)
+                MeshSimplifier::SimplifyOccluder(meshData, OCCLUDER_MAX_ERROR, occluderPositions, occluderIndices);
+            vector<Texture> meshTextures;
+            for (unsigned int texture : meshData.textures)
+                meshTextures.push_back(textures_loaded[texture]);
+            meshes.push_back(Mesh(std::move(meshData.vertices), meshData.indices, meshTextures, geometry, &meshData.bounds,
+                                  &meshData.lods));
+            vector<unsigned int>().swap(meshData.indices);
+            vector<MeshLod>().swap(meshData.lods);
+        }
+        // meshes with fewer levels keep drawing their coarsest one
+        lodErrors.assign(1, 0.0f);
+        for (const Mesh &mesh : meshes)
+            if (mesh.lodErrors.size() > lodErrors.size())
+                lodErrors.resize(mesh.lodErrors.size(), 0.0f);
+        for (unsigned int level = 1; level < lodErrors.size(); level++)
+            for (const Mesh &mesh : meshes)
+                lodErrors[level] = std::max(lodErrors[level], mesh.LodError(level));
+        geometry.Upload();
+        for (Mesh &mesh : meshes)
+            mesh.VAO = geometry.VAO;
+    }
+
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    unsigned int instanceBuffer = 0;
+
+    // prints how many textures turned out to be a single color (see Texture::constant) and how
+    // many texture binds of the meshes that saves
+    void reportConstantTextures(const ModelData &data) const
+    {
+        size_t constants = 0, binds = 0, constantBinds = 0;
+        for (const Texture &texture : textures_loaded)
+            constants += texture.constant;
+        if (constants == 0)
+            return;
+        for (const MeshData &mesh : data.meshes)
+            for (unsigned int texture : mesh.textures)
+            {
+                binds++;
+                constantBinds += textures_loaded[texture].constant;
+            }
+        cout << "MATERIAL_CONSTANTS:: " << directory << ": " << constants << "/" << textures_loaded.size()
+             << " textures are solid colors, not uploaded; " << constantBinds << "/" << binds
+             << " mesh texture units freed" << endl;
+    }
+
+    // instances into the instance buffer, created on first use
+    void uploadInstances(const ModelInstance *instances, unsigned int count)
+    {
+        if (!instanceBuffer)
+            setupInstanceAttributes();
+        // respecified every call, so the driver can hand out fresh storage instead of waiting for
+        // the previous draws
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(ModelInstance), instances, GL_STREAM_DRAW);
+    }
+
+    // points the InstanceAttribute locations of the model's vertex array at the instance buffer
+    void setupInstanceAttributes()
+    {
+        glGenBuffers(1, &instanceBuffer);
+        GLState::Get().BindVertexArray(geometry.VAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_TRANSFORM + column);
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE_TRANSFORM + column, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+                                  (void*)(offsetof(ModelInstance, transform) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE_TRANSFORM + column, 1);
+        }
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_TINT);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE_TINT, 3, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+                              (void*)offsetof(ModelInstance, tint));
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE_TINT, 1);
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_POINT_LIGHT);
+        glVertexAttribIPointer(INSTANCE_ATTRIBUTE_POINT_LIGHT, 1, GL_INT, sizeof(ModelInstance),
+                               (void*)offsetof(ModelInstance, pointLight));
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE_POINT_LIGHT, 1);
+    }
+
+    // loads a model from the cache or with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
+    {
+        ModelData data;
+        if (!LoadModelData(path, data))
+            return;
+        directory = DirectoryOf(path);
+
+        // load every referenced texture once
+        for (const TextureRef &ref : data.textures)
+        {
+            TextureSource source = TextureRegistry::Instance().Prepare(this->directory + '/' + ref.path);
+            Texture texture;
+            texture.id = TextureRegistry::Instance().Acquire(source);
+            texture.constant = source.isConstant;
+            texture.color = source.color;
+            texture.type = ref.type;
+            texture.path = ref.path;
+            textures_loaded.push_back(texture);
+        }
+        SetupMeshes(data);
+    }
+
+    static bool importModel(string const &path, ModelData &data)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        // vertices are joined so triangles share them, which is what makes the vertex cache useful at all
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, data);
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void processNode(aiNode *node, const aiScene *scene, ModelData &data)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -81,23 +364,23 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            data.meshes.push_back(processMesh(mesh, scene, data));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene, ModelData &data)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
-
+        MeshData result;
+        vector<Vertex> &vertices = result.vertices;
+        vector<unsigned int> &indices = result.indices;
+        vector<unsigned int> &textures = result.textures;
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -143,6 +426,8 @@ private:
 
 
         }
+        // bounding box and sphere for frustum culling, in model space
+        result.bounds = MeshBounds::FromVertices(vertices);
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
@@ -159,57 +444,53 @@ private:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
-        aiColor3D color(0.0f, 0.0f, 0.0f);
-        material->Get(AI_MATKEY_COLOR_AMBIENT, color);
-
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<unsigned int> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<unsigned int> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<unsigned int> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<unsigned int> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
 
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // checks all material textures of a given type and adds the ones not referenced yet to the model's texture table.
+    // the indices into that table are returned.
+    static vector<unsigned int> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, ModelData &data)
     {
-        vector<Texture> textures;
+        vector<unsigned int> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
+            // check if texture was referenced before and if so, reuse its entry: skip loading a new texture
             bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            for(unsigned int j = 0; j < data.textures.size(); j++)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                if(std::strcmp(data.textures[j].path.data(), str.C_Str()) == 0)
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+                    textures.push_back(j);
+                    skip = true; // a texture with the same filepath has already been referenced, continue to next one. (optimization)
                     break;
                 }
             }
             if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+            {   // if texture hasn't been referenced already, add it
+                TextureRef texture;
                 texture.type = typeName;
                 texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                textures.push_back(data.textures.size());
+                data.textures.push_back(texture);  // store it for entire model, to ensure we won't unnecesery load duplicate textures.
             }
         }
         return textures;
@@ -222,38 +503,6 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::Instance().Acquire(filename, gamma);
 }
 #endif
@@ -0,0 +1,101 @@
+#ifndef MULTI_DRAW_H
+#define MULTI_DRAW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <iostream>
+
+// The loader in libs/glad only covers GL 3.3, so the GL 4.3 pieces of the multi-draw indirect
+// path are declared here and its entry point is loaded by MultiDraw::Load.
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+// one record of the indirect buffer, laid out as glMultiDrawElementsIndirect reads it
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex; // in indices, not bytes
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand layout");
+
+// Per draw data of the multi-draw path, std430 and mirrored by DrawData in model_loading.vs. The
+// vertex shader reads element drawOffset + gl_DrawIDARB, drawOffset being the first draw of the
+// glMultiDrawElementsIndirect call.
+struct DrawData {
+    glm::mat4 model;
+    glm::vec4 positionScale;  // xyz, packed position dequantization
+    glm::vec4 positionOffset; // xyz
+    GLint pointLight;         // for shaders lit by a single point light
+    GLint diffuseLayer;       // Mesh::textureLayers, for textures in arrays
+    GLint specularLayer;
+    GLint pad;
+    glm::vec4 diffuseColor;   // Mesh::diffuseColor, for constant textures
+    glm::vec4 specularColor;
+};
+static_assert(sizeof(DrawData) == 144, "std430 DrawData layout");
+
+// shader storage binding of the DrawData array, a separate namespace from uniform block bindings
+const unsigned int DRAW_DATA_BINDING = 0;
+
+// Availability and entry point of glMultiDrawElementsIndirect. Besides a 4.3 context the vertex
+// shader needs GL_ARB_shader_draw_parameters for gl_DrawIDARB.
+class MultiDraw {
+public:
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect,
+                                                          GLsizei drawcount, GLsizei stride);
+
+    // checks the current context and loads the entry point, false leaves the path disabled
+    static bool Load(GLADloadproc load)
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major < 4 || (major == 4 && minor < 3))
+            return false;
+        if (!hasExtension("GL_ARB_shader_draw_parameters"))
+        {
+            std::cout << "ERROR::MULTI_DRAW::NO_SHADER_DRAW_PARAMETERS: GL " << major << "." << minor
+                      << " context without GL_ARB_shader_draw_parameters" << std::endl;
+            return false;
+        }
+        entryPoint() = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+        return entryPoint() != nullptr;
+    }
+
+    static bool Supported()
+    {
+        return entryPoint() != nullptr;
+    }
+
+    // indirect is a byte offset into the bound GL_DRAW_INDIRECT_BUFFER
+    static void MultiDrawElementsIndirect(GLenum mode, GLenum type, size_t indirect, GLsizei drawCount)
+    {
+        entryPoint()(mode, type, (const void *)indirect, drawCount, 0);
+    }
+
+private:
+    static MultiDrawElementsIndirectProc &entryPoint()
+    {
+        static MultiDrawElementsIndirectProc proc = nullptr;
+        return proc;
+    }
+
+    static bool hasExtension(const char *name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+            if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+                return true;
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,98 @@
+#ifndef OVERDRAW_VIEW_H
+#define OVERDRAW_VIEW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <memory>
+#include <vector>
+using namespace std;
+
+// Overdraw visualization. While counting, every fragment that passes the depth test increments
+// the stencil buffer; Scene counts only its lit pass, so with the depth pre-pass on the count is
+// how often a pixel ran the expensive fragment shaders. Show reads the counts back into
+// FrameStats and paints them over the frame as a heat map, one full screen triangle per count
+// with the stencil test picking its pixels. The framebuffer needs a stencil buffer, cleared
+// every frame.
+class OverdrawView {
+public:
+    static const int LEVELS = 8; // counts of LEVELS and more share the last color
+
+    bool visible = false;
+
+    void Create()
+    {
+        shader.reset(new Shader("resources/shaders/fullscreen_triangle.vs", "resources/shaders/overdraw.fs"));
+        colorLocation = shader->uniform("color");
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    void Destroy()
+    {
+        shader.reset();
+        GLState::Get().DeleteVertexArray(emptyVAO);
+        emptyVAO = 0;
+    }
+
+    static void BeginCounting()
+    {
+        GLState::Get().Enable(GL_STENCIL_TEST);
+        glStencilMask(0xFF);
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    }
+
+    static void EndCounting()
+    {
+        GLState::Get().Disable(GL_STENCIL_TEST);
+    }
+
+    // adds the counts of the current frame to FrameStats and draws the heat map over it,
+    // width x height being the framebuffer size
+    void Show(int width, int height)
+    {
+        FrameStats &stats = FrameStats::Get();
+        counts.resize((size_t)width * height);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, counts.data());
+        for (unsigned char count : counts)
+        {
+            stats.shadedFragments += count;
+            stats.coveredPixels += count > 0;
+        }
+
+        // black where nothing was drawn, then blue through green and yellow to red
+        static const glm::vec3 colors[LEVELS + 1] = {
+            glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.6f), glm::vec3(0.0f, 0.4f, 1.0f),
+            glm::vec3(0.0f, 0.8f, 0.6f), glm::vec3(0.2f, 0.9f, 0.0f), glm::vec3(0.9f, 0.9f, 0.0f),
+            glm::vec3(1.0f, 0.6f, 0.0f), glm::vec3(1.0f, 0.2f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f)
+        };
+        GLState &state = GLState::Get();
+        state.Disable(GL_DEPTH_TEST);
+        state.Enable(GL_STENCIL_TEST);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        shader->use();
+        state.BindVertexArray(emptyVAO);
+        for (int level = 0; level <= LEVELS; level++)
+        {
+            // the stencil test passes when ref <= stencil for the last level
+            glStencilFunc(level == LEVELS ? GL_LEQUAL : GL_EQUAL, level, 0xFF);
+            shader->setVec3(colorLocation, colors[level]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            stats.drawCalls++;
+        }
+        state.Disable(GL_STENCIL_TEST);
+        state.Enable(GL_DEPTH_TEST);
+    }
+
+private:
+    unique_ptr<Shader> shader;
+    GLint colorLocation = -1;
+    unsigned int emptyVAO = 0;
+    vector<unsigned char> counts;
+};
+#endif
@@ -0,0 +1,327 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/multi_draw.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+using namespace std;
+
+// One mesh to draw this frame. program indexes the queue's per-program uniform state, so it has
+// to stay the same for a given Shader.
+struct RenderItem {
+    uint64_t key;
+    Mesh *mesh;
+    unsigned int lod;           // level of detail to draw, see Mesh::Lod
+    Shader *shader;
+    unsigned int program;
+    const glm::mat4 *transform; // has to stay valid until Submit
+    GLint modelLocation;
+    GLint pointLightLocation;   // -1 if the shader uses every point light
+    int pointLight;
+    GLint positionScaleLocation;
+    GLint positionOffsetLocation;
+    GLint textureLayersLocation; // -1 unless the textures are in arrays
+    GLint diffuseColorLocation;  // constant texture colors, see Mesh::diffuseColor
+    GLint specularColorLocation;
+    GLint drawOffsetLocation;    // multi-draw path only
+};
+
+// Collects the draws of a frame and submits them sorted by a 64 bit key, most significant first:
+//
+//   program (8 bits) | texture set (20 bits) | vertex array (16 bits) | depth (20 bits)
+//
+// so all draws of a program are issued together, within a program all meshes sharing textures,
+// and those front to back. Binds go through GLState, which drops the ones sorting made redundant;
+// per draw uniforms a program already holds are skipped here.
+//
+// With multiDraw set (GL 4.3, see MultiDraw) the sorted items instead become one indirect command
+// and one DrawData record each, uploaded once per frame, and every run of items sharing program,
+// textures, vertex array and index type is a single glMultiDrawElementsIndirect. The programs have
+// to be compiled with MULTI_DRAW, which takes the per draw uniforms from the DrawData array.
+//
+// A depthOnly queue (the depth pre-pass, see Scene::depthPrepass) binds no textures and sets no
+// material uniforms, only the transform and position dequantization.
+class RenderQueue {
+public:
+    bool multiDraw = false;
+    bool depthOnly = false;
+
+    static const unsigned int PROGRAM_BITS = 8;
+    static const unsigned int MATERIAL_BITS = 20;
+    static const unsigned int VERTEX_ARRAY_BITS = 16;
+    static const unsigned int DEPTH_BITS = 20;
+
+    // depth is the view space distance, clamped to [0, farPlane]
+    static uint64_t MakeKey(unsigned int program, unsigned int material, unsigned int vertexArray, float depth,
+                            float farPlane)
+    {
+        float normalized = std::min(std::max(depth / farPlane, 0.0f), 1.0f);
+        uint64_t quantized = (uint64_t)(normalized * ((1u << DEPTH_BITS) - 1));
+        return ((uint64_t)(program & ((1u << PROGRAM_BITS) - 1)) << (MATERIAL_BITS + VERTEX_ARRAY_BITS + DEPTH_BITS))
+               | ((uint64_t)(material & ((1u << MATERIAL_BITS) - 1)) << (VERTEX_ARRAY_BITS + DEPTH_BITS))
+               | ((uint64_t)(vertexArray & ((1u << VERTEX_ARRAY_BITS) - 1)) << DEPTH_BITS)
+               | quantized;
+    }
+
+    // small stable id for the set of textures a mesh binds, meshes with the same textures share it.
+    // Constant textures bind nothing (id 0), so meshes differing only in their colors share it too.
+    unsigned int MaterialId(const vector<Texture> &textures)
+    {
+        vector<unsigned int> ids;
+        for (const Texture &texture : textures)
+            ids.push_back(texture.id);
+        auto material = materials.find(ids);
+        if (material != materials.end())
+            return material->second;
+        unsigned int id = materials.size();
+        materials[ids] = id;
+        return id;
+    }
+
+    void Clear()
+    {
+        items.clear();
+    }
+
+    void Add(const RenderItem &item)
+    {
+        items.push_back(item);
+    }
+
+    // sorts and draws everything added since Clear
+    void Submit()
+    {
+        sort(items.begin(), items.end(), [](const RenderItem &a, const RenderItem &b) { return a.key < b.key; });
+        for (ProgramState &program : programs)
+            program.transform = nullptr;
+        if (multiDraw)
+            submitIndirect();
+        else
+            submitDirect();
+    }
+
+    // frees the multi-draw buffers, needs the GL context
+    void Destroy()
+    {
+        if (indirectBuffer)
+        {
+            GLState::Get().DeleteBuffer(indirectBuffer);
+            GLState::Get().DeleteBuffer(drawDataBuffer);
+            indirectBuffer = drawDataBuffer = 0;
+        }
+    }
+
+private:
+    // uniform values a program was last given by the queue
+    struct ProgramState {
+        const glm::mat4 *transform = nullptr;
+        int pointLight = -1;
+        // packed position dequantization, starting at the shader's defaults
+        glm::vec3 positionScale = glm::vec3(1.0f);
+        glm::vec3 positionOffset = glm::vec3(0.0f);
+        glm::ivec2 textureLayers = glm::ivec2(0, 0);
+        glm::vec4 diffuseColor = glm::vec4(0.0f);
+        glm::vec4 specularColor = glm::vec4(0.0f);
+        vector<int> samplers; // texture unit per sampler location, -1 if not set yet
+    };
+
+    vector<RenderItem> items;
+    vector<ProgramState> programs;
+    map<vector<unsigned int>, unsigned int> materials;
+
+    // multi-draw path, rebuilt every frame
+    unsigned int indirectBuffer = 0, drawDataBuffer = 0;
+    vector<DrawElementsIndirectCommand> commands;
+    vector<DrawData> drawData;
+
+    // one glDrawElementsBaseVertex per item
+    void submitDirect()
+    {
+        FrameStats &stats = FrameStats::Get();
+        GLState &state = GLState::Get();
+        for (const RenderItem &item : items)
+        {
+            Shader &shader = *item.shader;
+            shader.use();
+            ProgramState &program = programState(item.program);
+
+            // uniforms keep their values per program, so remember what every program was last given
+            if (program.transform != item.transform)
+            {
+                shader.setMat4(item.modelLocation, *item.transform);
+                program.transform = item.transform;
+            }
+            else
+                stats.uniformUploadsSkipped++;
+            if (item.pointLightLocation >= 0)
+            {
+                if (program.pointLight != item.pointLight)
+                {
+                    shader.setInt(item.pointLightLocation, item.pointLight);
+                    program.pointLight = item.pointLight;
+                }
+                else
+                    stats.uniformUploadsSkipped++;
+            }
+
+            Mesh &mesh = *item.mesh;
+            if (program.positionScale != mesh.positionScale || program.positionOffset != mesh.positionOffset)
+            {
+                shader.setVec3(item.positionScaleLocation, mesh.positionScale);
+                shader.setVec3(item.positionOffsetLocation, mesh.positionOffset);
+                program.positionScale = mesh.positionScale;
+                program.positionOffset = mesh.positionOffset;
+            }
+            else
+                stats.uniformUploadsSkipped++;
+            if (!depthOnly)
+            {
+                if (item.textureLayersLocation >= 0)
+                {
+                    if (program.textureLayers != mesh.textureLayers)
+                    {
+                        shader.setIVec2(item.textureLayersLocation, mesh.textureLayers);
+                        program.textureLayers = mesh.textureLayers;
+                    }
+                    else
+                        stats.uniformUploadsSkipped++;
+                }
+                if (program.diffuseColor != mesh.diffuseColor || program.specularColor != mesh.specularColor)
+                {
+                    shader.setVec4(item.diffuseColorLocation, mesh.diffuseColor);
+                    shader.setVec4(item.specularColorLocation, mesh.specularColor);
+                    program.diffuseColor = mesh.diffuseColor;
+                    program.specularColor = mesh.specularColor;
+                }
+                else
+                    stats.uniformUploadsSkipped++;
+                bindTextures(shader, program, mesh);
+            }
+            state.BindVertexArray(mesh.VAO);
+            const GeometryRange &range = mesh.Lod(item.lod);
+            glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, (void*)range.indexOffset,
+                                     range.baseVertex);
+            stats.drawCalls++;
+            stats.triangles += range.indexCount / 3;
+            stats.lodDraws += item.lod > 0;
+            stats.vertexBytes += mesh.DrawnVertexBytes(item.lod);
+        }
+    }
+
+    // one indirect command per item, one glMultiDrawElementsIndirect per run of compatible items
+    void submitIndirect()
+    {
+        if (items.empty())
+            return;
+        FrameStats &stats = FrameStats::Get();
+        GLState &state = GLState::Get();
+        if (!indirectBuffer)
+        {
+            glGenBuffers(1, &indirectBuffer);
+            glGenBuffers(1, &drawDataBuffer);
+        }
+
+        commands.clear();
+        drawData.clear();
+        for (const RenderItem &item : items)
+        {
+            const Mesh &mesh = *item.mesh;
+            const GeometryRange &range = mesh.Lod(item.lod);
+            unsigned int indexSize = range.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            commands.push_back(DrawElementsIndirectCommand{range.indexCount, 1, (GLuint)(range.indexOffset / indexSize),
+                                                           range.baseVertex, 0});
+            stats.triangles += range.indexCount / 3;
+            stats.lodDraws += item.lod > 0;
+            DrawData draw = DrawData();
+            draw.model = *item.transform;
+            draw.positionScale = glm::vec4(mesh.positionScale, 0.0f);
+            draw.positionOffset = glm::vec4(mesh.positionOffset, 0.0f);
+            draw.pointLight = item.pointLight;
+            draw.diffuseLayer = mesh.textureLayers.x;
+            draw.specularLayer = mesh.textureLayers.y;
+            draw.diffuseColor = mesh.diffuseColor;
+            draw.specularColor = mesh.specularColor;
+            drawData.push_back(draw);
+        }
+        // both buffers are respecified every frame, so the driver can hand out fresh storage
+        // instead of waiting for last frame's draws
+        state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(),
+                     GL_STREAM_DRAW);
+        state.BindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, drawData.size() * sizeof(DrawData), drawData.data(), GL_STREAM_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+
+        const unsigned int batchShift = VERTEX_ARRAY_BITS + DEPTH_BITS; // program and texture set
+        for (size_t first = 0; first < items.size();)
+        {
+            const RenderItem &item = items[first];
+            Mesh &mesh = *item.mesh;
+            size_t last = first + 1;
+            unsigned long vertexBytes = mesh.DrawnVertexBytes(item.lod);
+            while (last < items.size() && items[last].key >> batchShift == item.key >> batchShift
+                   && items[last].mesh->VAO == mesh.VAO && items[last].mesh->geometry.indexType == mesh.geometry.indexType)
+            {
+                vertexBytes += items[last].mesh->DrawnVertexBytes(items[last].lod);
+                last++;
+            }
+
+            Shader &shader = *item.shader;
+            shader.use();
+            shader.setInt(item.drawOffsetLocation, first);
+            if (!depthOnly)
+                bindTextures(shader, programState(item.program), mesh);
+            state.BindVertexArray(mesh.VAO);
+            MultiDraw::MultiDrawElementsIndirect(GL_TRIANGLES, mesh.geometry.indexType,
+                                                 first * sizeof(DrawElementsIndirectCommand), last - first);
+            stats.drawCalls++;
+            stats.indirectDraws += last - first;
+            stats.vertexBytes += vertexBytes;
+            first = last;
+        }
+    }
+
+    ProgramState &programState(unsigned int program)
+    {
+        if (program >= programs.size())
+            programs.resize(program + 1);
+        return programs[program];
+    }
+
+    // binds the mesh's textures to units 0..n and points the samplers at them, if they are not
+    // already. Constant textures are left out, the shader uses their color.
+    void bindTextures(Shader &shader, ProgramState &program, Mesh &mesh)
+    {
+        FrameStats &stats = FrameStats::Get();
+        const vector<GLint> &samplers = mesh.SamplerLocations(shader);
+        for (unsigned int i = 0; i < mesh.textures.size(); i++)
+        {
+            if (mesh.textures[i].constant)
+                continue;
+            if (samplers[i] >= 0)
+            {
+                if (program.samplers.size() <= (size_t)samplers[i])
+                    program.samplers.resize(samplers[i] + 1, -1);
+                if (program.samplers[samplers[i]] != (int)i)
+                {
+                    shader.setInt(samplers[i], i);
+                    program.samplers[samplers[i]] = i;
+                }
+                else
+                    stats.uniformUploadsSkipped++;
+            }
+            GLState::Get().BindTexture(i, mesh.textures[i].target, mesh.textures[i].id);
+        }
+    }
+};
+#endif
@@ -0,0 +1,848 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/asset_loader.h>
+#include <learnopengl/bounds.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/frame_uniforms.h>
+#include <learnopengl/hiz_occlusion.h>
+#include <learnopengl/model.h>
+#include <learnopengl/overdraw_view.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/shader_m.h>
+#include <learnopengl/software_occlusion.h>
+
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+struct DirLight {
+    glm::vec3 direction;
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+struct SpotLight {
+    glm::vec3 position;
+    glm::vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+};
+
+// how Scene hides entities behind the occluder models
+enum OcclusionMode {
+    OCCLUSION_OFF,
+    OCCLUSION_GPU, // HiZOcclusion
+    OCCLUSION_CPU  // SoftwareOcclusion
+};
+
+// one placed object. Entities only refer to models and shaders by index and keep their
+// transform precomputed, so the renderer walks a flat array without touching any strings.
+struct SceneEntity {
+    glm::mat4 transform;
+    unsigned int model;  // index into Scene::models
+    unsigned int shader; // index into Scene::shaders
+    int pointLight;      // point light for shaders lit by a single one, -1 if the shader uses all of them
+    glm::vec3 tint;      // multiplies the lit color, only applied to instanced entities
+};
+
+// a linked program with the locations the renderer sets per entity
+struct SceneShader {
+    Shader program;
+    GLint model;
+    GLint pointLightIndex;
+    GLint positionScale;
+    GLint positionOffset;
+    GLint drawOffset; // multi-draw variant only
+    int instanced;    // index into Scene::instancedShaders of the INSTANCED variant, -1 if there is none
+    GLint textureLayers;
+    GLint diffuseColor;
+    GLint specularColor;
+};
+
+// Scene description loaded from a text file, e.g. resources/scenes/village.scene. One
+// declaration per line, '#' starts a comment, angles are in degrees:
+//
+//     shader      <name> <vertex path> <fragment path>
+//     model       <name> [float | packed] [clustered] [occluder] <path, may contain spaces>   (flags in any order)
+//     directional <direction xyz> <ambient rgb> <diffuse rgb> <specular rgb>
+//     spotlight   <ambient rgb> <diffuse rgb> <specular rgb> <cutOff> <outerCutOff>
+//     pointlight  <position xyz> <ambient rgb> <diffuse rgb> <specular rgb> <constant> <linear> <quadratic>
+//     entity      <model> <shader> <position xyz> <rotation angle> <rotation axis xyz> <scale> <light index | all> [<tint rgb>]
+//
+// Shaders and models have to be declared before the entities using them. Models are uploaded
+// with full float vertices unless declared packed (see PackedVertex); clustered models have
+// their meshes split into clusters of at most CLUSTER_TRIANGLES triangles at import (see
+// MeshClusterer), for large static geometry like the village. The spotlight is
+// attached to the camera, so it has no position or direction of its own.
+//
+// Entities of occluder models hide the others: after frustum culling the occluders in view are
+// rendered into a small depth pyramid and every other entity in view is tested against it with
+// its world space bounds (see OcclusionMode), whole entities rather than meshes.
+//
+// Forward shading passes the first FRAME_POINT_LIGHTS point lights to the scene's shaders, and an
+// entity's light index picks one of those. With deferred the fragment shaders are swapped for
+// gbuffer.fs and DeferredShading lights the frame afterwards with every point light of the scene,
+// each reaching every surface in its range; the light indices are ignored.
+//
+// With depthPrepass the visible meshes are first drawn depth only, front to back, with
+// depth_prepass.vs; the lit pass then runs with GL_LEQUAL and depth writes off, so the scene's
+// fragment shaders run once per pixel instead of once per surface drawn over it.
+//
+// Entities sharing both model and shader with at least MIN_INSTANCES - 1 others are drawn
+// together with Model::DrawInstanced, one draw call per mesh however many there are. Only those
+// get their tint, the per mesh draws ignore it.
+//
+// Frustum culling walks a Bvh over the world space bounds of every mesh of every entity drawn
+// on its own (instanced ones are tested per instance), built on the first Draw.
+//
+// Every entity is drawn at the coarsest level of detail of its model (see Model::SelectLod)
+// whose simplification error projects to at most Model::LOD_PIXEL_ERROR pixels at the distance
+// of its bounding sphere; instanced entities are split by level, one DrawInstanced each.
+class Scene {
+public:
+    static const unsigned int MIN_INSTANCES = 2;
+    static const unsigned int CLUSTER_TRIANGLES = 1024;
+    static const unsigned int BVH_LEAF_SIZE = 4;
+    static const int SOFTWARE_OCCLUSION_WIDTH = 256; // resolution of the OCCLUSION_CPU depth buffer
+    static const int SOFTWARE_OCCLUSION_HEIGHT = 128;
+
+    vector<string> shaderNames;
+    vector<string> modelNames;
+    vector<string> modelPaths;
+    vector<VertexFormat> modelFormats;
+    vector<bool> modelClustered;
+    vector<bool> modelOccluder;
+    vector<Model> models;
+    vector<SceneShader> shaders;
+    vector<Shader> instancedShaders;
+    vector<SceneEntity> entities;
+
+    DirLight directional = DirLight();
+    SpotLight spotlight = SpotLight();
+    vector<PointLight> pointLights;
+
+    // skip meshes whose bounds lie outside the view frustum
+    bool frustumCulling = true;
+    // cull through the Bvh instead of testing every mesh's bounds
+    bool bvhCulling = true;
+    // submit through glMultiDrawElementsIndirect, only if MultiDraw::Load succeeded. Has to be set
+    // before CreateShaders, which compiles the MULTI_DRAW variants for it.
+    bool multiDraw = false;
+    // draw repeated entities with Model::DrawInstanced, has to be set before CreateShaders
+    bool instancing = true;
+    // copy every model's textures into texture arrays (see TextureArrays), has to be set before
+    // CreateShaders and LoadModels
+    bool textureArrays = false;
+    // render into DeferredShading's G-buffer instead of shading with the scene's fragment shaders,
+    // has to be set before CreateShaders
+    bool deferred = false;
+    // draw distant entities at a coarser level of detail of their model
+    bool lod = true;
+    // occlusion culling against the occluder models, has to be set before CreateShaders and LoadModels
+    OcclusionMode occlusion = OCCLUSION_GPU;
+    // lay down the depth of the visible meshes before shading them
+    bool depthPrepass = false;
+    // count the fragments of the lit pass in the stencil buffer, see OverdrawView
+    bool countOverdraw = false;
+    // framebuffer and viewport Draw renders into, restored after the occlusion passes
+    unsigned int targetFramebuffer = 0;
+    glm::ivec4 targetViewport = glm::ivec4(0);
+
+    // parses the scene file, no GL calls. Returns false and prints the offending line on errors.
+    bool Load(const string &path)
+    {
+        ifstream file(path);
+        if (!file)
+        {
+            cout << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ: " << path << endl;
+            return false;
+        }
+
+        string line;
+        unsigned int lineNumber = 0;
+        while (getline(file, line))
+        {
+            lineNumber++;
+            size_t comment = line.find('#');
+            if (comment != string::npos)
+                line.erase(comment);
+            istringstream in(line);
+            string keyword;
+            if (!(in >> keyword))
+                continue;
+
+            if (!parseLine(keyword, in))
+            {
+                cout << "ERROR::SCENE::PARSE_ERROR: " << path << ":" << lineNumber << ": " << line << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // queues every model of the scene on loader, the models are ready once loader.Finish() returns.
+    // With the shaders already created, every model only stores the vertex attributes the shaders
+    // of its entities read.
+    void LoadModels(AssetLoader &loader)
+    {
+        vector<unsigned int> attributes(modelPaths.size(), shaders.empty() ? VERTEX_ATTRIBUTES_ALL : 0);
+        if (!shaders.empty())
+            for (const SceneEntity &entity : entities)
+                attributes[entity.model] |= shaders[entity.shader].program.attributeMask;
+
+        models.clear();
+        models.resize(modelPaths.size());
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            models[i].vertexFormat = modelFormats[i];
+            models[i].vertexAttributes = attributes[i];
+            models[i].textureArrays = textureArrays;
+            models[i].clusterTriangles = modelClustered[i] ? CLUSTER_TRIANGLES : 0;
+            models[i].keepOccluderGeometry = occlusion == OCCLUSION_CPU && modelOccluder[i];
+            loader.Load(models[i], modelPaths[i]);
+        }
+    }
+
+    // vertex and index buffer memory of every model, next to what full float vertices and 32 bit
+    // indices would take
+    void PrintGeometryStats() const
+    {
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            size_t vertices = 0, indices = 0, shortMeshes = 0;
+            for (const Mesh &mesh : models[i].meshes)
+            {
+                vertices += mesh.vertexCount;
+                indices += mesh.geometry.indexCount;
+                shortMeshes += mesh.geometry.indexType == GL_UNSIGNED_SHORT;
+            }
+            size_t vertexBytes = models[i].geometry.VertexBytes();
+            size_t indexBytes = models[i].geometry.IndexBytes();
+            cout << "GEOMETRY:: " << modelNames[i] << ": " << vertices << " vertices, " << vertexBytes / 1024 << " KB of "
+                 << (modelFormats[i] == VERTEX_FORMAT_PACKED ? "packed" : "float") << " vertex buffers ("
+                 << vertices * sizeof(Vertex) / 1024 << " KB with every float attribute); " << indices << " indices, "
+                 << indexBytes / 1024 << " KB of index buffers (" << indices * sizeof(uint32_t) / 1024 << " KB as 32 bit), "
+                 << shortMeshes << "/" << models[i].meshes.size() << " meshes with 16 bit indices" << endl;
+            if (models[i].lodErrors.size() > 1)
+            {
+                cout << "GEOMETRY:: " << modelNames[i] << ": levels of detail";
+                for (unsigned int level = 1; level < models[i].lodErrors.size(); level++)
+                {
+                    size_t lodIndices = 0;
+                    for (const Mesh &mesh : models[i].meshes)
+                        lodIndices += mesh.Lod(level).indexCount;
+                    cout << (level > 1 ? ", " : " ") << lodIndices * 100 / std::max<size_t>(indices, 1) << "% of the triangles (error "
+                         << models[i].lodErrors[level] << ")";
+                }
+                cout << endl;
+            }
+        }
+    }
+
+    // compiles the shaders, points them at the frame uniform buffer and resolves the per-entity
+    // locations. Shaders of instanced entities get an INSTANCED variant as well.
+    void CreateShaders()
+    {
+        const string defines = textureArrays ? "#define TEXTURE_ARRAYS\n" : "";
+        const string header = multiDraw ? "#version 430 core\n#define MULTI_DRAW\n" + defines
+                                        : textureArrays ? "#version 330 core\n" + defines : "";
+        queue.multiDraw = multiDraw;
+        if (!deferred && pointLights.size() > FRAME_POINT_LIGHTS)
+            cout << "ERROR::SCENE::TOO_MANY_POINT_LIGHTS: forward shading uses the first " << FRAME_POINT_LIGHTS << " of "
+                 << pointLights.size() << ", deferred shading all of them" << endl;
+        findInstanceGroups();
+        shaders.clear();
+        instancedShaders.clear();
+        // every entity keeps its vertex shader, the G-buffer takes the same inputs from all of them
+        const char *const gBufferFragment = "resources/shaders/gbuffer.fs";
+        for (const pair<string, string> &source : shaderSources)
+            shaders.push_back(SceneShader{Shader(source.first.c_str(), deferred ? gBufferFragment : source.second.c_str(), header),
+                                          -1, -1, -1, -1, -1, -1, -1, -1, -1});
+        for (const InstanceGroup &group : instanceGroups)
+        {
+            SceneShader &shader = shaders[group.shader];
+            if (shader.instanced >= 0)
+                continue;
+            const pair<string, string> &source = shaderSources[group.shader];
+            shader.instanced = instancedShaders.size();
+            instancedShaders.push_back(Shader(source.first.c_str(), deferred ? gBufferFragment : source.second.c_str(),
+                                              "#version 330 core\n#define INSTANCED\n" + defines));
+        }
+        for (SceneShader &shader : shaders)
+        {
+            FrameUniformBuffer::Bind(shader.program);
+            shader.program.use();
+            shader.program.setFloat("material.shininess", 32.0f);
+            shader.model = shader.program.uniform("model");
+            shader.pointLightIndex = shader.program.uniform("pointLightIndex");
+            shader.positionScale = shader.program.uniform("positionScale");
+            shader.positionOffset = shader.program.uniform("positionOffset");
+            shader.drawOffset = shader.program.uniform("drawOffset");
+            shader.textureLayers = shader.program.uniform("textureLayers");
+            shader.diffuseColor = shader.program.uniform("diffuseColor");
+            shader.specularColor = shader.program.uniform("specularColor");
+        }
+        for (Shader &shader : instancedShaders)
+        {
+            FrameUniformBuffer::Bind(shader);
+            shader.use();
+            shader.setFloat("material.shininess", 32.0f);
+        }
+        hiz.Destroy();
+        if (occlusion == OCCLUSION_GPU)
+            hiz.Create();
+
+        // the depth pre-pass, one program for all entities since it only needs positions
+        prepassQueue.multiDraw = multiDraw;
+        prepassQueue.depthOnly = true;
+        prepassShader.reset(new Shader("resources/shaders/depth_prepass.vs", "resources/shaders/occluder_depth.fs",
+                                       multiDraw ? "#version 430 core\n#define MULTI_DRAW\n" : ""));
+        FrameUniformBuffer::Bind(*prepassShader);
+        prepassModel = prepassShader->uniform("model");
+        prepassPositionScale = prepassShader->uniform("positionScale");
+        prepassPositionOffset = prepassShader->uniform("positionOffset");
+        prepassDrawOffset = prepassShader->uniform("drawOffset");
+        prepassInstancedShader.reset();
+        if (!instanceGroups.empty())
+        {
+            prepassInstancedShader.reset(new Shader("resources/shaders/depth_prepass.vs", "resources/shaders/occluder_depth.fs",
+                                                    "#version 330 core\n#define INSTANCED\n"));
+            FrameUniformBuffer::Bind(*prepassInstancedShader);
+            prepassInstancedPositionScale = prepassInstancedShader->uniform("positionScale");
+            prepassInstancedPositionOffset = prepassInstancedShader->uniform("positionOffset");
+        }
+    }
+
+    // queues every mesh of every entity inside the view frustum and submits them sorted by program,
+    // textures and depth. viewportHeight in pixels, for the level of detail selection.
+    void Draw(const glm::mat4 &view, const glm::mat4 &projection, float farPlane, float viewportHeight)
+    {
+        if (draws.empty())
+            buildDraws();
+        selectLods(view, projection, viewportHeight);
+
+        FrameStats &stats = FrameStats::Get();
+        if (frustumCulling)
+        {
+            typedef std::chrono::steady_clock Clock;
+            Clock::time_point start = Clock::now();
+            Frustum frustum(projection * view);
+            size_t nodesVisited = 0;
+            size_t visible = bvhCulling ? drawBvh.Cull(frustum, drawVisible, &nodesVisited)
+                                        : drawBounds.Cull(frustum, drawVisible);
+            stats.cullNodesVisited += nodesVisited;
+            for (InstanceGroup &group : instanceGroups)
+                group.bounds.Cull(frustum, group.visible);
+            stats.cullMicroseconds += std::chrono::duration<float, std::micro>(Clock::now() - start).count();
+            stats.meshesTested += draws.size();
+            stats.meshesCulled += draws.size() - visible;
+        }
+        else
+        {
+            drawVisible.assign(draws.size(), 1);
+            for (InstanceGroup &group : instanceGroups)
+                group.visible.assign(group.instances.size(), 1);
+        }
+        entityOccluded.assign(entities.size(), 0);
+        if (occlusion != OCCLUSION_OFF && hasOccluders)
+            cullOccluded(projection * view);
+
+        queue.Clear();
+        prepassQueue.Clear();
+        for (size_t i = 0; i < draws.size(); i++)
+        {
+            if (!drawVisible[i] || entityOccluded[draws[i].entity])
+                continue;
+            const SceneDraw &draw = draws[i];
+            const SceneEntity &entity = entities[draw.entity];
+            SceneShader &shader = shaders[entity.shader];
+            float depth = -(view * entity.transform[3]).z;
+
+            RenderItem item;
+            item.key = RenderQueue::MakeKey(entity.shader, draw.material, draw.mesh->VAO, depth, farPlane);
+            item.mesh = draw.mesh;
+            item.lod = entityLod[draw.entity];
+            item.shader = &shader.program;
+            item.program = entity.shader;
+            item.transform = &entity.transform;
+            item.modelLocation = shader.model;
+            item.pointLightLocation = shader.pointLightIndex;
+            item.pointLight = entity.pointLight;
+            item.positionScaleLocation = shader.positionScale;
+            item.positionOffsetLocation = shader.positionOffset;
+            item.textureLayersLocation = shader.textureLayers;
+            item.diffuseColorLocation = shader.diffuseColor;
+            item.specularColorLocation = shader.specularColor;
+            item.drawOffsetLocation = shader.drawOffset;
+            queue.Add(item);
+            if (depthPrepass)
+                prepassQueue.Add(depthItem(item, depth, farPlane));
+        }
+        for (InstanceGroup &group : instanceGroups)
+        {
+            group.visibleInstances.resize(models[group.model].lodErrors.size());
+            for (vector<ModelInstance> &instances : group.visibleInstances)
+                instances.clear();
+            for (size_t i = 0; i < group.instances.size(); i++)
+                if (group.visible[i] && !entityOccluded[group.entities[i]])
+                    group.visibleInstances[entityLod[group.entities[i]]].push_back(group.instances[i]);
+        }
+
+        GLState &state = GLState::Get();
+        if (depthPrepass)
+        {
+            drawDepthPrepass();
+            state.DepthFunc(GL_LEQUAL);
+            state.DepthMask(false);
+        }
+        if (countOverdraw)
+            OverdrawView::BeginCounting();
+        queue.Submit();
+        for (InstanceGroup &group : instanceGroups)
+        {
+            Model &model = models[group.model];
+            Shader &shader = instancedShaders[shaders[group.shader].instanced];
+            for (unsigned int level = 0; level < group.visibleInstances.size(); level++)
+            {
+                const vector<ModelInstance> &instances = group.visibleInstances[level];
+                if (instances.empty())
+                    continue;
+                shader.use();
+                model.DrawInstanced(shader, instances.data(), instances.size(), level);
+            }
+        }
+        if (countOverdraw)
+            OverdrawView::EndCounting();
+        if (depthPrepass)
+        {
+            state.DepthMask(true);
+            state.DepthFunc(GL_LESS);
+        }
+    }
+
+    void ReleaseTextures()
+    {
+        draws.clear();
+        for (Model &model : models)
+            model.ReleaseTextures();
+    }
+
+    // GL objects of the models and the renderer
+    void ReleaseBuffers()
+    {
+        for (Model &model : models)
+            model.ReleaseBuffers();
+        queue.Destroy();
+        prepassQueue.Destroy();
+        hiz.Destroy();
+    }
+
+private:
+    // one mesh of one entity, with its texture set resolved once instead of every frame
+    struct SceneDraw {
+        unsigned int entity;
+        Mesh *mesh;
+        unsigned int material;
+    };
+
+    // entities of one model and shader, drawn with one Model::DrawInstanced
+    struct InstanceGroup {
+        unsigned int model;
+        unsigned int shader;
+        vector<unsigned int> entities;
+        vector<ModelInstance> instances;         // of every entity, built once
+        BoundsArray bounds;                      // world space bounds of every instance
+        vector<unsigned char> visible;           // culling result of the current frame
+        vector<vector<ModelInstance>> visibleInstances; // what goes to the instance buffer this frame, per level of detail
+    };
+
+    // vertex and fragment path of every declared shader, compiled by CreateShaders
+    vector<pair<string, string>> shaderSources;
+    vector<InstanceGroup> instanceGroups;
+    vector<int> entityGroup; // instance group of every entity, -1 for per mesh draws
+    vector<SceneDraw> draws;
+    BoundsArray drawBounds;             // world space bounds of every draw, entities do not move
+    Bvh drawBvh;                        // over the same bounds
+    vector<unsigned char> drawVisible;  // culling result of the current frame
+    vector<MeshBounds> entityBounds;    // world space bounds of every entity's model
+    vector<float> entityScale;          // largest scale factor of every entity's transform
+    vector<unsigned int> entityLod;     // level of detail of every entity this frame
+    RenderQueue queue;
+
+    bool hasOccluders = false;             // any entity of an occluder model
+    HiZOcclusion hiz;                      // OCCLUSION_GPU
+    SoftwareOcclusion software;            // OCCLUSION_CPU, holds the simplified occluders in world space
+    vector<unsigned char> entityInFrustum; // anything of the entity passed frustum culling this frame
+    vector<unsigned char> entityOccluded;  // hidden behind the occluders this frame
+    vector<unsigned int> occlusionEntities; // the entities tested this frame
+    vector<MeshBounds> occlusionBoxes;      // and their bounds
+    vector<unsigned char> occlusionVisible;
+
+    unique_ptr<Shader> prepassShader;          // depth_prepass.vs
+    unique_ptr<Shader> prepassInstancedShader; // its INSTANCED variant, if there are instance groups
+    GLint prepassModel = -1, prepassPositionScale = -1, prepassPositionOffset = -1, prepassDrawOffset = -1;
+    GLint prepassInstancedPositionScale = -1, prepassInstancedPositionOffset = -1;
+    RenderQueue prepassQueue;                  // depthOnly, sorted by vertex array and front to back
+
+    void buildDraws()
+    {
+        for (Model &model : models)
+            model.SetShaderTextureNamePrefix("material.");
+        drawBounds.Clear();
+        vector<MeshBounds> worldBounds;
+        entityBounds.clear();
+        entityScale.clear();
+        for (const SceneEntity &entity : entities)
+        {
+            const glm::mat4 &m = entity.transform;
+            entityBounds.push_back(models[entity.model].bounds.Transformed(m));
+            entityScale.push_back(std::sqrt(std::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                                            std::max(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])),
+                                                     glm::dot(glm::vec3(m[2]), glm::vec3(m[2]))))));
+        }
+        for (InstanceGroup &group : instanceGroups)
+        {
+            const Model &model = models[group.model];
+            group.instances.clear();
+            group.bounds.Clear();
+            for (unsigned int entity : group.entities)
+            {
+                ModelInstance instance;
+                instance.transform = entities[entity].transform;
+                instance.tint = entities[entity].tint;
+                instance.pointLight = entities[entity].pointLight;
+                group.instances.push_back(instance);
+                group.bounds.Add(model.bounds.Transformed(instance.transform));
+            }
+        }
+        for (unsigned int i = 0; i < entities.size(); i++)
+        {
+            if (entityGroup[i] >= 0)
+                continue;
+            for (Mesh &mesh : models[entities[i].model].meshes)
+            {
+                draws.push_back(SceneDraw{i, &mesh, queue.MaterialId(mesh.textures)});
+                worldBounds.push_back(mesh.bounds.Transformed(entities[i].transform));
+                drawBounds.Add(worldBounds.back());
+            }
+        }
+        drawBvh.Build(worldBounds, BVH_LEAF_SIZE);
+
+        hasOccluders = false;
+        software.Clear();
+        software.Resize(SOFTWARE_OCCLUSION_WIDTH, SOFTWARE_OCCLUSION_HEIGHT);
+        for (const SceneEntity &entity : entities)
+        {
+            if (!modelOccluder[entity.model])
+                continue;
+            hasOccluders = true;
+            const Model &model = models[entity.model];
+            if (occlusion == OCCLUSION_CPU)
+                software.AddOccluder(model.occluderPositions, model.occluderIndices, entity.transform);
+        }
+    }
+
+    // item of the depth pre-pass for the lit item
+    RenderItem depthItem(const RenderItem &item, float depth, float farPlane) const
+    {
+        RenderItem depthOnly = item;
+        depthOnly.key = RenderQueue::MakeKey(0, 0, item.mesh->VAO, depth, farPlane);
+        depthOnly.shader = prepassShader.get();
+        depthOnly.program = 0;
+        depthOnly.modelLocation = prepassModel;
+        depthOnly.pointLightLocation = -1;
+        depthOnly.positionScaleLocation = prepassPositionScale;
+        depthOnly.positionOffsetLocation = prepassPositionOffset;
+        depthOnly.textureLayersLocation = -1;
+        depthOnly.diffuseColorLocation = -1;
+        depthOnly.specularColorLocation = -1;
+        depthOnly.drawOffsetLocation = prepassDrawOffset;
+        return depthOnly;
+    }
+
+    // depth of everything the lit pass is about to draw, color writes off
+    void drawDepthPrepass()
+    {
+        GLState::Get().ColorMask(false);
+        prepassQueue.Submit();
+        for (InstanceGroup &group : instanceGroups)
+            for (unsigned int level = 0; level < group.visibleInstances.size(); level++)
+            {
+                const vector<ModelInstance> &instances = group.visibleInstances[level];
+                if (instances.empty())
+                    continue;
+                prepassInstancedShader->use();
+                models[group.model].DrawInstancedDepth(*prepassInstancedShader, prepassInstancedPositionScale,
+                                                       prepassInstancedPositionOffset, instances.data(),
+                                                       instances.size(), level);
+            }
+        GLState::Get().ColorMask(true);
+    }
+
+    // marks the entities in view hidden behind the occluders in view in entityOccluded
+    void cullOccluded(const glm::mat4 &viewProjection)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        entityInFrustum.assign(entities.size(), 0);
+        for (size_t i = 0; i < draws.size(); i++)
+            if (drawVisible[i])
+                entityInFrustum[draws[i].entity] = 1;
+        for (const InstanceGroup &group : instanceGroups)
+            for (size_t i = 0; i < group.entities.size(); i++)
+                if (group.visible[i])
+                    entityInFrustum[group.entities[i]] = 1;
+        occlusionEntities.clear();
+        occlusionBoxes.clear();
+        for (unsigned int i = 0; i < entities.size(); i++)
+            if (entityInFrustum[i] && !modelOccluder[entities[i].model])
+            {
+                occlusionEntities.push_back(i);
+                occlusionBoxes.push_back(entityBounds[i]);
+            }
+        if (occlusionBoxes.empty())
+        {
+            if (occlusion == OCCLUSION_GPU)
+                hiz.Skip();
+            return;
+        }
+
+        if (occlusion == OCCLUSION_GPU)
+        {
+            // the occluder meshes in view, whether drawn on their own or instanced
+            hiz.Begin(viewProjection, targetFramebuffer, targetViewport);
+            for (size_t i = 0; i < draws.size(); i++)
+                if (drawVisible[i] && modelOccluder[entities[draws[i].entity].model])
+                    hiz.DrawOccluder(*draws[i].mesh, entities[draws[i].entity].transform);
+            for (const InstanceGroup &group : instanceGroups)
+                if (modelOccluder[group.model])
+                    for (size_t i = 0; i < group.entities.size(); i++)
+                        if (group.visible[i])
+                            for (const Mesh &mesh : models[group.model].meshes)
+                                hiz.DrawOccluder(mesh, group.instances[i].transform);
+            hiz.Test(occlusionBoxes, occlusionEntities, viewProjection, occlusionVisible);
+        }
+        else
+        {
+            software.Render(viewProjection);
+            software.Cull(occlusionBoxes, viewProjection, occlusionVisible);
+        }
+
+        FrameStats &stats = FrameStats::Get();
+        for (size_t i = 0; i < occlusionEntities.size(); i++)
+            if (!occlusionVisible[i])
+            {
+                entityOccluded[occlusionEntities[i]] = 1;
+                stats.occlusionCulled++;
+            }
+        stats.occlusionTested += occlusionEntities.size();
+        stats.occlusionMicroseconds += std::chrono::duration<float, std::micro>(Clock::now() - start).count();
+    }
+
+    // level of detail of every entity: one model unit at view distance d covers
+    // projection[1][1] * viewportHeight / 2 / d * scale pixels, d taken to the near side of the
+    // bounding sphere so no part of the model gets a coarser level than it should
+    void selectLods(const glm::mat4 &view, const glm::mat4 &projection, float viewportHeight)
+    {
+        entityLod.assign(entities.size(), 0);
+        if (!lod)
+            return;
+        float pixelsAtUnitDistance = projection[1][1] * viewportHeight * 0.5f;
+        for (size_t i = 0; i < entities.size(); i++)
+        {
+            const Model &model = models[entities[i].model];
+            if (model.lodErrors.size() < 2)
+                continue;
+            const MeshBounds &bounds = entityBounds[i];
+            float distance = glm::length(glm::vec3(view * glm::vec4(bounds.center, 1.0f))) - bounds.radius;
+            if (distance <= 0.0f)
+                continue;
+            entityLod[i] = model.SelectLod(pixelsAtUnitDistance / distance * entityScale[i]);
+        }
+    }
+
+    // groups the entities sharing model and shader, MIN_INSTANCES or more of them
+    void findInstanceGroups()
+    {
+        instanceGroups.clear();
+        entityGroup.assign(entities.size(), -1);
+        if (!instancing)
+            return;
+        map<pair<unsigned int, unsigned int>, vector<unsigned int>> groups;
+        for (unsigned int i = 0; i < entities.size(); i++)
+            groups[make_pair(entities[i].model, entities[i].shader)].push_back(i);
+        for (const auto &group : groups)
+        {
+            if (group.second.size() < MIN_INSTANCES)
+                continue;
+            for (unsigned int entity : group.second)
+                entityGroup[entity] = instanceGroups.size();
+            InstanceGroup instanceGroup;
+            instanceGroup.model = group.first.first;
+            instanceGroup.shader = group.first.second;
+            instanceGroup.entities = group.second;
+            instanceGroups.push_back(instanceGroup);
+        }
+    }
+
+    bool parseLine(const string &keyword, istringstream &in)
+    {
+        if (keyword == "shader")
+        {
+            string name, vertexPath, fragmentPath;
+            if (!(in >> name >> vertexPath >> fragmentPath) || indexOf(shaderNames, name) >= 0)
+                return false;
+            shaderNames.push_back(name);
+            shaderSources.push_back(make_pair(vertexPath, fragmentPath));
+            return true;
+        }
+        if (keyword == "model")
+        {
+            string name, path;
+            if (!(in >> name) || indexOf(modelNames, name) >= 0)
+                return false;
+            VertexFormat format = VERTEX_FORMAT_FLOAT;
+            bool formatSet = false, clustered = false, occluder = false;
+            // flags in any order until the first word with a '/' or '.', where the path starts;
+            // an unknown or repeated flag fails the line
+            while (in >> ws && in.peek() != EOF)
+            {
+                streampos start = in.tellg();
+                string flag;
+                in >> flag;
+                if (flag.find_first_of("/.") != string::npos)
+                {
+                    in.seekg(start);
+                    break;
+                }
+                if ((flag == "float" || flag == "packed") && !formatSet)
+                {
+                    format = flag == "packed" ? VERTEX_FORMAT_PACKED : VERTEX_FORMAT_FLOAT;
+                    formatSet = true;
+                }
+                else if (flag == "clustered" && !clustered)
+                    clustered = true;
+                else if (flag == "occluder" && !occluder)
+                    occluder = true;
+                else
+                    return false;
+            }
+            getline(in, path);
+            while (!path.empty() && isspace((unsigned char)path.back()))
+                path.pop_back();
+            if (path.empty())
+                return false;
+            modelNames.push_back(name);
+            modelPaths.push_back(path);
+            modelFormats.push_back(format);
+            modelClustered.push_back(clustered);
+            modelOccluder.push_back(occluder);
+            return true;
+        }
+        if (keyword == "directional")
+            return readVec3(in, directional.direction) && readVec3(in, directional.ambient)
+                   && readVec3(in, directional.diffuse) && readVec3(in, directional.specular);
+        if (keyword == "spotlight")
+        {
+            float cutOff, outerCutOff;
+            if (!readVec3(in, spotlight.ambient) || !readVec3(in, spotlight.diffuse) || !readVec3(in, spotlight.specular)
+                || !(in >> cutOff >> outerCutOff))
+                return false;
+            spotlight.cutOff = glm::cos(glm::radians(cutOff));
+            spotlight.outerCutOff = glm::cos(glm::radians(outerCutOff));
+            return true;
+        }
+        if (keyword == "pointlight")
+        {
+            PointLight light;
+            if (!readVec3(in, light.position) || !readVec3(in, light.ambient) || !readVec3(in, light.diffuse)
+                || !readVec3(in, light.specular) || !(in >> light.constant >> light.linear >> light.quadratic))
+                return false;
+            pointLights.push_back(light);
+            return true;
+        }
+        if (keyword == "entity")
+        {
+            string model, shader, light;
+            glm::vec3 position, axis;
+            float angle, scale;
+            if (!(in >> model >> shader) || !readVec3(in, position) || !(in >> angle) || !readVec3(in, axis)
+                || !(in >> scale >> light))
+                return false;
+
+            SceneEntity entity;
+            entity.tint = glm::vec3(1.0f);
+            if (!(in >> ws).eof() && !readVec3(in, entity.tint))
+                return false;
+
+            int modelIndex = indexOf(modelNames, model);
+            int shaderIndex = indexOf(shaderNames, shader);
+            if (modelIndex < 0 || shaderIndex < 0)
+                return false;
+            entity.model = modelIndex;
+            entity.shader = shaderIndex;
+            if (light == "all")
+                entity.pointLight = -1;
+            else
+            {
+                istringstream index(light);
+                if (!(index >> entity.pointLight) || entity.pointLight < 0 || entity.pointLight >= (int)FRAME_POINT_LIGHTS)
+                    return false;
+            }
+
+            entity.transform = glm::translate(glm::mat4(1.0f), position);
+            if (angle != 0.0f)
+                entity.transform = glm::rotate(entity.transform, glm::radians(angle), axis);
+            entity.transform = glm::scale(entity.transform, glm::vec3(scale));
+            entities.push_back(entity);
+            return true;
+        }
+        return false;
+    }
+
+    static bool readVec3(istringstream &in, glm::vec3 &value)
+    {
+        return (bool)(in >> value.x >> value.y >> value.z);
+    }
+
+    static int indexOf(const vector<string> &names, const string &name)
+    {
+        for (size_t i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return i;
+        return -1;
+    }
+};
+#endif
@@ -8,14 +8,23 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 #include <common.h>
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/gl_state.h>
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // locations of all active uniforms, filled once after linking
+    std::unordered_map<std::string, GLint> uniformLocations;
+    // bit per vertex attribute location the program reads, so meshes can leave out the rest
+    unsigned int attributeMask = 0;
+    // constructor generates the shader on the fly. A non-empty header replaces the #version line
+    // of both sources, so a variant can raise the version and add defines.
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string &header = "")
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
@@ -50,6 +59,11 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        if (!header.empty())
+        {
+            replaceVersion(vertexCode, header);
+            replaceVersion(fragmentCode, header);
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -73,74 +87,204 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-
+        cacheUniformLocations();
+        cacheAttributeMask();
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        GLState::Get().UseProgram(ID);
+    }
+    // location of a uniform, to be passed to the setters below instead of its name so the
+    // frame loop does no string work. -1 (ignored by glUniform*) if there is no such active uniform.
+    // ------------------------------------------------------------------------
+    GLint uniform(const std::string &name) const
+    {
+        FrameStats::Get().uniformNameLookups++;
+        auto location = uniformLocations.find(name);
+        return location != uniformLocations.end() ? location->second : -1;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
+    void setBool(GLint location, bool value) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniform1i(location, (int)value);
+    }
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setBool(uniform(name), value);
     }
     // ------------------------------------------------------------------------
+    void setInt(GLint location, int value) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniform1i(location, value);
+    }
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        setInt(uniform(name), value);
     }
     // ------------------------------------------------------------------------
+    void setFloat(GLint location, float value) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniform1f(location, value);
+    }
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        setFloat(uniform(name), value);
     }
     // ------------------------------------------------------------------------
+    void setVec2(GLint location, const glm::vec2 &value) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniform2fv(location, 1, &value[0]);
+    }
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec2(uniform(name), value);
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(uniform(name), glm::vec2(x, y));
+    }
+    void setIVec2(GLint location, const glm::ivec2 &value) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniform2i(location, value.x, value.y);
     }
     // ------------------------------------------------------------------------
+    void setVec3(GLint location, const glm::vec3 &value) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniform3fv(location, 1, &value[0]);
+    }
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(uniform(name), value);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(uniform(name), glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
+    void setVec4(GLint location, const glm::vec4 &value) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniform4fv(location, 1, &value[0]);
+    }
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(uniform(name), value);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        setVec4(uniform(name), glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
+    void setMat2(GLint location, const glm::mat2 &mat) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniform(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat3(GLint location, const glm::mat3 &mat) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniform(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat4(GLint location, const glm::mat4 &mat) const
+    {
+        FrameStats::Get().uniformUploads++;
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniform(name), mat);
     }
 
 private:
+    // swaps the #version line of code for header, which has to start with its own
+    // ------------------------------------------------------------------------
+    static void replaceVersion(std::string &code, const std::string &header)
+    {
+        size_t version = code.find("#version");
+        if (version == std::string::npos)
+        {
+            std::cout << "ERROR::SHADER::NO_VERSION_LINE" << std::endl;
+            return;
+        }
+        size_t end = code.find('\n', version);
+        code.replace(version, end == std::string::npos ? std::string::npos : end + 1 - version, header);
+    }
+    // introspects every active uniform once, so the setters never have to ask the driver.
+    // arrays are registered under "name", "name[0]" and each "name[i]".
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, i, buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            FrameStats::Get().uniformLocationQueries++;
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0) // member of a uniform block
+                continue;
+            uniformLocations[name] = location;
+
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations[base] = location;
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    FrameStats::Get().uniformLocationQueries++;
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+    // collects the locations of the active vertex attributes, matrices take one per column
+    // ------------------------------------------------------------------------
+    void cacheAttributeMask()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveAttrib(ID, i, buffer.size(), &length, &size, &type, buffer.data());
+            GLint location = glGetAttribLocation(ID, buffer.data());
+            if (location < 0) // built-ins like gl_VertexID
+                continue;
+            GLint columns = type == GL_FLOAT_MAT2 ? 2 : type == GL_FLOAT_MAT3 ? 3 : type == GL_FLOAT_MAT4 ? 4 : 1;
+            for (GLint slot = 0; slot < size * columns && location + slot < 32; slot++)
+                attributeMask |= 1u << (location + slot);
+        }
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,408 @@
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+using namespace std;
+
+// Hierarchical depth (Hi-Z) pyramid: level 0 is a depth buffer in window coordinates ([0, 1],
+// 1 at the far plane), every further level half the size and holding the farthest depth of the
+// up to 2x2 texels below it. A box is hidden when its nearest depth lies behind the farthest
+// depth of every texel it covers; the test reads the level where the box's screen rectangle
+// spans at most 2x2 texels. HiZOcclusion runs the same test in a shader on a GPU built pyramid.
+//
+// Level 0 is rasterized with one sample at each texel center, which says nothing about the rest
+// of the texel: an occluder's silhouette or a gap between occluders can pass between the samples.
+// Build therefore first erodes it: a texel keeps its depth only if the samples around it are
+// covered too, the farthest depth of its 3x3 neighbourhood, so it counts as occluded only where
+// the occluders cover all of it. Texels on the border lack neighbours and never occlude.
+class DepthPyramid {
+public:
+    int width = 0, height = 0;
+    vector<vector<float>> levels;
+    vector<glm::ivec2> sizes;
+
+    void Resize(int levelWidth, int levelHeight)
+    {
+        width = levelWidth;
+        height = levelHeight;
+        levels.clear();
+        sizes.clear();
+        while (true)
+        {
+            sizes.push_back(glm::ivec2(levelWidth, levelHeight));
+            levels.push_back(vector<float>((size_t)levelWidth * levelHeight, 1.0f));
+            if (levelWidth == 1 && levelHeight == 1)
+                break;
+            levelWidth = std::max(1, (levelWidth + 1) / 2);
+            levelHeight = std::max(1, (levelHeight + 1) / 2);
+        }
+    }
+
+    // level 0, to be filled before Build
+    vector<float> &Depth()
+    {
+        return levels[0];
+    }
+
+    // erodes level 0 and fills the levels above it
+    void Build()
+    {
+        erode();
+        for (size_t level = 1; level < levels.size(); level++)
+        {
+            const vector<float> &below = levels[level - 1];
+            glm::ivec2 belowSize = sizes[level - 1], size = sizes[level];
+            vector<float> &out = levels[level];
+            for (int y = 0; y < size.y; y++)
+                for (int x = 0; x < size.x; x++)
+                {
+                    int x0 = 2 * x, y0 = 2 * y;
+                    int x1 = std::min(x0 + 1, belowSize.x - 1), y1 = std::min(y0 + 1, belowSize.y - 1);
+                    out[(size_t)y * size.x + x] = std::max(std::max(below[(size_t)y0 * belowSize.x + x0], below[(size_t)y0 * belowSize.x + x1]),
+                                                           std::max(below[(size_t)y1 * belowSize.x + x0], below[(size_t)y1 * belowSize.x + x1]));
+                }
+        }
+    }
+
+    // false only if the world space box is certainly behind the depth in the pyramid
+    bool IsVisible(const MeshBounds &box, const glm::mat4 &viewProjection) const
+    {
+        glm::vec3 minimum(1e30f), maximum(-1e30f);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 p((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                        (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+            // reaching through the near plane, in front of everything
+            if (clip.w <= 1e-5f || clip.z < -clip.w)
+                return true;
+            glm::vec3 window = glm::vec3(clip) / clip.w * 0.5f + glm::vec3(0.5f);
+            minimum = glm::min(minimum, window);
+            maximum = glm::max(maximum, window);
+        }
+        if (maximum.x < 0.0f || maximum.y < 0.0f || minimum.x >= 1.0f || minimum.y >= 1.0f)
+            return false;
+
+        int x0 = std::max(0, (int)std::floor(minimum.x * width)), y0 = std::max(0, (int)std::floor(minimum.y * height));
+        int x1 = std::min(width - 1, (int)std::floor(maximum.x * width));
+        int y1 = std::min(height - 1, (int)std::floor(maximum.y * height));
+        size_t level = 0;
+        while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            level++;
+        const vector<float> &depth = levels[level];
+        int levelWidth = sizes[level].x;
+        float farthest = 0.0f;
+        for (int y = y0 >> level; y <= y1 >> level; y++)
+            for (int x = x0 >> level; x <= x1 >> level; x++)
+                farthest = std::max(farthest, depth[(size_t)y * levelWidth + x]);
+        return minimum.z <= farthest;
+    }
+
+private:
+    vector<float> rowFarthest;
+
+    // level 0 = the farthest depth of every texel's 3x3 neighbourhood, a row and a column pass
+    void erode()
+    {
+        vector<float> &depth = levels[0];
+        rowFarthest.resize(depth.size());
+        for (int y = 0; y < height; y++)
+        {
+            const float *row = &depth[(size_t)y * width];
+            float *out = &rowFarthest[(size_t)y * width];
+            for (int x = 0; x < width; x++)
+                out[x] = x == 0 || x == width - 1 ? 1.0f : std::max(row[x], std::max(row[x - 1], row[x + 1]));
+        }
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+            {
+                size_t i = (size_t)y * width + x;
+                depth[i] = y == 0 || y == height - 1 ? 1.0f
+                           : std::max(rowFarthest[i], std::max(rowFarthest[i - width], rowFarthest[i + width]));
+            }
+    }
+};
+
+// CPU fallback of HiZOcclusion: rasterizes the occluder triangles (world space, front faces only,
+// like the GPU draws them) into the low resolution level 0 of a DepthPyramid, one pixel center
+// sample each, keeping the nearest depth, and lets DepthPyramid::Build erode it. Needs no GL, so it also runs headless (--test-occlusion).
+//
+// The screen is split into TILE_WIDTH x TILE_HEIGHT tiles. Render transforms the vertices, clips
+// and sets up the triangles in SETUP_BATCHES batches, each binning its triangles into the tiles
+// their bounds overlap, then rasterizes the tiles: every tile by one thread, its bins batch by
+// batch in triangle order, four pixels of a row at a time with SSE. No two threads write the same
+// pixel and every pixel sees the same triangles in the same order whatever the thread count, so
+// the depth buffer is the same bit for bit with one thread or many.
+class SoftwareOcclusion {
+public:
+    static const int TILE_WIDTH = 32;  // a multiple of 4, the SSE width
+    static const int TILE_HEIGHT = 32;
+    static const unsigned int SETUP_BATCHES = 16; // fixed, so the bins do not depend on the thread count
+    static const size_t TRANSFORM_CHUNK = 4096;   // vertices per transform job
+
+    vector<glm::vec3> positions; // occluder triangles in world space
+    vector<unsigned int> indices;
+    DepthPyramid pyramid;
+
+    // threadCount == 0 uses one worker per hardware thread, 1 renders on the calling thread only
+    explicit SoftwareOcclusion(unsigned int threadCount = 0) : threadCount(threadCount)
+    {
+    }
+
+    // width is rounded up to a multiple of 4
+    void Resize(int width, int height)
+    {
+        pyramid.Resize((width + 3) & ~3, height);
+        tilesX = (pyramid.width + TILE_WIDTH - 1) / TILE_WIDTH;
+        tilesY = (pyramid.height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    }
+
+    // removes every occluder
+    void Clear()
+    {
+        positions.clear();
+        indices.clear();
+    }
+
+    // appends a mesh's triangles, transformed into world space
+    void AddOccluder(const vector<glm::vec3> &meshPositions, const vector<unsigned int> &meshIndices,
+                     const glm::mat4 &transform)
+    {
+        unsigned int base = positions.size();
+        for (const glm::vec3 &p : meshPositions)
+            positions.push_back(glm::vec3(transform * glm::vec4(p, 1.0f)));
+        for (unsigned int index : meshIndices)
+            indices.push_back(base + index);
+    }
+
+    // rasterizes every occluder and builds the pyramid
+    void Render(const glm::mat4 &viewProjection)
+    {
+        if (threadCount != 1 && !pool)
+            pool.reset(new ThreadPool(threadCount));
+
+        clip.resize(positions.size());
+        parallelFor((positions.size() + TRANSFORM_CHUNK - 1) / TRANSFORM_CHUNK, [&](size_t chunk) {
+            size_t end = std::min(positions.size(), (chunk + 1) * TRANSFORM_CHUNK);
+            for (size_t i = chunk * TRANSFORM_CHUNK; i < end; i++)
+                clip[i] = viewProjection * glm::vec4(positions[i], 1.0f);
+        });
+
+        batches.resize(SETUP_BATCHES);
+        size_t triangleCount = indices.size() / 3;
+        parallelFor(SETUP_BATCHES, [&](size_t b) {
+            Batch &batch = batches[b];
+            batch.triangles.clear();
+            batch.bins.resize(tilesX * tilesY);
+            for (vector<uint32_t> &bin : batch.bins)
+                bin.clear();
+            for (size_t t = triangleCount * b / SETUP_BATCHES; t < triangleCount * (b + 1) / SETUP_BATCHES; t++)
+                setupTriangle(batch, clip[indices[3 * t]], clip[indices[3 * t + 1]], clip[indices[3 * t + 2]]);
+        });
+
+        parallelFor(tilesX * tilesY, [&](size_t tile) { rasterizeTile(tile); });
+        pyramid.Build();
+    }
+
+    bool IsVisible(const MeshBounds &box, const glm::mat4 &viewProjection) const
+    {
+        return pyramid.IsVisible(box, viewProjection);
+    }
+
+    // Sets visible[i] for every box not hidden behind the occluders of the last Render and
+    // returns how many are, like BoundsArray::Cull for the frustum
+    size_t Cull(const vector<MeshBounds> &boxes, const glm::mat4 &viewProjection, vector<unsigned char> &visible) const
+    {
+        visible.resize(boxes.size());
+        size_t visibleCount = 0;
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            visible[i] = pyramid.IsVisible(boxes[i], viewProjection);
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+
+private:
+    // a screen space triangle ready to rasterize: edge functions and depth as planes in x and y,
+    // evaluated at pixel centers, and its pixel bounds
+    struct Triangle {
+        float edgeX[3], edgeY[3], edge[3];
+        float depthX, depthY, depth;
+        int x0, y0, x1, y1;
+    };
+
+    // the triangles set up from one range of the occluder triangles, and per tile the ones touching it
+    struct Batch {
+        vector<Triangle> triangles;
+        vector<vector<uint32_t>> bins;
+    };
+
+    unsigned int threadCount;
+    unique_ptr<ThreadPool> pool;
+    int tilesX = 0, tilesY = 0;
+    vector<glm::vec4> clip; // clip space positions of the current Render
+    vector<Batch> batches;
+
+    // runs job(0) .. job(count - 1), on the pool's workers and the calling thread
+    template <typename Job>
+    void parallelFor(size_t count, const Job &job)
+    {
+        if (!pool || count < 2)
+        {
+            for (size_t i = 0; i < count; i++)
+                job(i);
+            return;
+        }
+        std::atomic<size_t> next(0);
+        auto worker = [&] {
+            for (size_t i = next++; i < count; i = next++)
+                job(i);
+        };
+        vector<std::future<void>> workers;
+        for (unsigned int i = 0; i < std::min<size_t>(pool->size(), count - 1); i++)
+            workers.push_back(pool->submit(worker));
+        worker();
+        for (std::future<void> &done : workers)
+            done.get();
+    }
+
+    // clips against the near plane (z >= -w), the only plane that matters for the division; the
+    // others are handled by the screen bounds of every triangle
+    void setupTriangle(Batch &batch, const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+    {
+        const glm::vec4 *in[3] = {&a, &b, &c};
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const glm::vec4 &p = *in[i], &q = *in[(i + 1) % 3];
+            float dp = p.z + p.w, dq = q.z + q.w;
+            if (dp >= 0.0f)
+                polygon[count++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                polygon[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+        if (count < 3)
+            return;
+        glm::vec3 window[4];
+        for (int i = 0; i < count; i++)
+        {
+            float w = std::max(polygon[i].w, 1e-6f);
+            window[i] = glm::vec3((polygon[i].x / w * 0.5f + 0.5f) * pyramid.width,
+                                  (polygon[i].y / w * 0.5f + 0.5f) * pyramid.height, polygon[i].z / w * 0.5f + 0.5f);
+        }
+        for (int i = 2; i < count; i++)
+            addTriangle(batch, window[0], window[i - 1], window[i]);
+    }
+
+    // counter-clockwise triangles only (front faces with y up), depth interpolated linearly in
+    // screen space, which is exact for window z
+    void addTriangle(Batch &batch, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (!(area > 0.0f))
+            return;
+        Triangle triangle;
+        triangle.x0 = std::max(0, (int)std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f));
+        triangle.x1 = std::min(pyramid.width - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f));
+        triangle.y0 = std::max(0, (int)std::ceil(std::min(a.y, std::min(b.y, c.y)) - 0.5f));
+        triangle.y1 = std::min(pyramid.height - 1, (int)std::floor(std::max(a.y, std::max(b.y, c.y)) - 0.5f));
+        if (triangle.x0 > triangle.x1 || triangle.y0 > triangle.y1)
+            return;
+
+        // edge i runs from corner i + 1 to corner i + 2 and is positive on the inside
+        const glm::vec3 *corner[3] = {&a, &b, &c};
+        for (int i = 0; i < 3; i++)
+        {
+            const glm::vec3 &p = *corner[(i + 1) % 3], &q = *corner[(i + 2) % 3];
+            triangle.edgeX[i] = p.y - q.y;
+            triangle.edgeY[i] = q.x - p.x;
+            triangle.edge[i] = (q.y - p.y) * p.x - (q.x - p.x) * p.y;
+        }
+        float inverseArea = 1.0f / area;
+        triangle.depthX = ((b.z - a.z) * (c.y - a.y) - (b.y - a.y) * (c.z - a.z)) * inverseArea;
+        triangle.depthY = ((b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z)) * inverseArea;
+        triangle.depth = a.z - triangle.depthX * a.x - triangle.depthY * a.y;
+
+        uint32_t index = batch.triangles.size();
+        batch.triangles.push_back(triangle);
+        for (int ty = triangle.y0 / TILE_HEIGHT; ty <= triangle.y1 / TILE_HEIGHT; ty++)
+            for (int tx = triangle.x0 / TILE_WIDTH; tx <= triangle.x1 / TILE_WIDTH; tx++)
+                batch.bins[ty * tilesX + tx].push_back(index);
+    }
+
+    void rasterizeTile(size_t tile)
+    {
+        int tileX0 = (int)(tile % tilesX) * TILE_WIDTH, tileY0 = (int)(tile / tilesX) * TILE_HEIGHT;
+        int tileX1 = std::min(tileX0 + TILE_WIDTH, pyramid.width) - 1;
+        int tileY1 = std::min(tileY0 + TILE_HEIGHT, pyramid.height) - 1;
+        float *depth = pyramid.Depth().data();
+        for (int y = tileY0; y <= tileY1; y++)
+            std::fill(depth + (size_t)y * pyramid.width + tileX0, depth + (size_t)y * pyramid.width + tileX1 + 1, 1.0f);
+
+        for (const Batch &batch : batches)
+            for (uint32_t index : batch.bins[tile])
+            {
+                const Triangle &t = batch.triangles[index];
+                // whole groups of four, the edge functions reject the pixels outside the triangle
+                int x0 = std::max(t.x0, tileX0) & ~3, x1 = std::min(t.x1, tileX1);
+                for (int y = std::max(t.y0, tileY0); y <= std::min(t.y1, tileY1); y++)
+                    rasterizeRow(t, depth + (size_t)y * pyramid.width, x0, x1, y + 0.5f);
+            }
+    }
+
+    // pixels x0 .. x1 of one row, x0 a multiple of 4. The scalar loop evaluates the same
+    // expressions in the same order as the SSE one, so both give the same depths.
+    static void rasterizeRow(const Triangle &t, float *row, int x0, int x1, float py)
+    {
+        float rowEdge[3];
+        for (int i = 0; i < 3; i++)
+            rowEdge[i] = t.edgeY[i] * py + t.edge[i];
+        float rowDepth = t.depthY * py + t.depth;
+#ifdef BOUNDS_SSE
+        __m128 edgeX0 = _mm_set1_ps(t.edgeX[0]), edgeX1 = _mm_set1_ps(t.edgeX[1]), edgeX2 = _mm_set1_ps(t.edgeX[2]);
+        __m128 rowEdge0 = _mm_set1_ps(rowEdge[0]), rowEdge1 = _mm_set1_ps(rowEdge[1]), rowEdge2 = _mm_set1_ps(rowEdge[2]);
+        __m128 depthX = _mm_set1_ps(t.depthX), depthRow = _mm_set1_ps(rowDepth);
+        __m128 zero = _mm_setzero_ps();
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)x0), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+        __m128 step = _mm_set1_ps(4.0f);
+        for (int x = x0; x <= x1; x += 4, px = _mm_add_ps(px, step))
+        {
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(edgeX0, px), rowEdge0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(edgeX1, px), rowEdge1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(edgeX2, px), rowEdge2);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            if (!_mm_movemask_ps(inside))
+                continue;
+            __m128 z = _mm_max_ps(_mm_add_ps(_mm_mul_ps(depthX, px), depthRow), zero);
+            __m128 stored = _mm_loadu_ps(row + x);
+            __m128 nearest = _mm_min_ps(stored, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+        }
+#else
+        for (int x = x0; x <= x1; x++)
+        {
+            float px = x + 0.5f;
+            if (t.edgeX[0] * px + rowEdge[0] < 0.0f || t.edgeX[1] * px + rowEdge[1] < 0.0f
+                || t.edgeX[2] * px + rowEdge[2] < 0.0f)
+                continue;
+            float z = std::max(t.depthX * px + rowDepth, 0.0f);
+            row[x] = std::min(row[x], z);
+        }
+#endif
+    }
+};
+#endif
@@ -0,0 +1,82 @@
+#ifndef STATS_OVERLAY_H
+#define STATS_OVERLAY_H
+
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_opengl3.h>
+
+#include <learnopengl/frame_stats.h>
+
+// Small ImGui window in the top left corner with the FrameStats of the current frame. It takes
+// no input (the camera owns the mouse), so the GLFW backend is set up without its callbacks. The
+// OpenGL3 backend restores every piece of state it touches, which keeps GLState's copy valid.
+class StatsOverlay {
+public:
+    bool visible = false;
+
+    void Init(GLFWwindow *window)
+    {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGui::GetIO().IniFilename = nullptr;
+        ImGui::StyleColorsDark();
+        ImGui_ImplGlfw_InitForOpenGL(window, false);
+        ImGui_ImplOpenGL3_Init("#version 330 core");
+    }
+
+    // call after the frame is drawn, so stats hold all of it
+    void Draw(const FrameStats &stats, float frameSeconds)
+    {
+        if (!visible)
+            return;
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+
+        ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f));
+        ImGui::SetNextWindowBgAlpha(0.6f);
+        ImGui::Begin("Frame stats", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize
+                                            | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_NoFocusOnAppearing
+                                            | ImGuiWindowFlags_NoNav);
+        ImGui::Text("frame: %.2f ms", frameSeconds * 1000.0f);
+        ImGui::Text("draw calls: %u, %lu KB of vertices", stats.drawCalls, stats.vertexBytes / 1024);
+        ImGui::Text("triangles: %lu, %u draws at a lower level of detail", stats.triangles, stats.lodDraws);
+        if (stats.instances)
+            ImGui::Text("instanced: %u model copies", stats.instances);
+        if (stats.indirectDraws)
+            ImGui::Text("multi-draw: %u commands", stats.indirectDraws);
+        if (stats.lightVolumes)
+            ImGui::Text("deferred: %u point light volumes", stats.lightVolumes);
+        ImGui::Separator();
+        ImGui::Text("meshes: %u tested, %u culled, %u drawn", stats.meshesTested, stats.meshesCulled,
+                    stats.meshesTested - stats.meshesCulled);
+        ImGui::Text("culling: %.1f us, %u bvh nodes", stats.cullMicroseconds, stats.cullNodesVisited);
+        ImGui::Text("occlusion: %u tested, %u hidden, %.1f us", stats.occlusionTested, stats.occlusionCulled,
+                    stats.occlusionMicroseconds);
+        if (stats.coveredPixels)
+            ImGui::Text("overdraw: %.2f fragments shaded per pixel", (double)stats.shadedFragments / stats.coveredPixels);
+        ImGui::Separator();
+        unsigned int issued = 0, filtered = 0;
+        for (int call = 0; call < STATE_CALL_COUNT; call++)
+        {
+            issued += stats.stateIssued[call];
+            filtered += stats.stateFiltered[call];
+        }
+        ImGui::Text("gl state: %u issued, %u filtered", issued, filtered);
+        ImGui::Text("vertex array binds: %u, %u filtered", stats.stateIssued[STATE_VERTEX_ARRAY],
+                    stats.stateFiltered[STATE_VERTEX_ARRAY]);
+        ImGui::Text("uniforms: %u uploads, %u skipped", stats.uniformUploads, stats.uniformUploadsSkipped);
+        ImGui::End();
+
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+
+    void Shutdown()
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
+};
+#endif
@@ -0,0 +1,193 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frame_stats.h>
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+struct Texture {
+    unsigned int id = 0;
+    string type;
+    string path;
+    GLenum target = GL_TEXTURE_2D;
+    int layer = 0; // within id when target is GL_TEXTURE_2D_ARRAY
+    // a single color image (see UniformColor), drawn with color instead of being uploaded; id is 0
+    bool constant = false;
+    glm::vec4 color = glm::vec4(1.0f);
+};
+
+// Copies a model's 2D textures into GL_TEXTURE_2D_ARRAYs at load time, so meshes differ in a layer
+// index instead of in the textures bound. Uncompressed textures are resampled (linear blit) to
+// the next power of two square between MIN_LAYER_SIZE and MAX_LAYER_SIZE and share an RGBA8
+// array per size; block compressed ones cannot be resampled or rendered to, so they are copied
+// level by level into an array of their own format and size.
+class TextureArrays {
+public:
+    static const int MIN_LAYER_SIZE = 16;
+    static const int MAX_LAYER_SIZE = 2048;
+
+    // points every texture at its array and layer and returns the arrays created. The 2D
+    // textures are left alone, the caller releases them; constant ones are skipped. Needs the GL
+    // context.
+    static vector<unsigned int> Build(vector<Texture> &textures, size_t *bytes = nullptr)
+    {
+        // array format, width and height -> textures going into it
+        map<tuple<GLint, GLint, GLint>, vector<size_t>> groups;
+        vector<GLint> levels(textures.size(), 1);
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            if (textures[i].constant)
+                continue;
+            GLint width = 0, height = 0, compressed = GL_FALSE, format = 0;
+            GLState::Get().BindTexture(GL_TEXTURE_2D, textures[i].id);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+            if (compressed)
+            {
+                glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &levels[i]);
+                levels[i] = std::min(levels[i] + 1, mipLevels(std::max(width, height)));
+                groups[make_tuple(format, width, height)].push_back(i);
+            }
+            else
+            {
+                // textures that failed to load (0 x 0) get a layer too, left black
+                GLint size = MIN_LAYER_SIZE;
+                while (size < std::max(width, height) && size < MAX_LAYER_SIZE)
+                    size *= 2;
+                groups[make_tuple((GLint)GL_RGBA8, size, size)].push_back(i);
+            }
+        }
+
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        vector<unsigned int> arrays;
+        GLuint framebuffers[2];
+        glGenFramebuffers(2, framebuffers);
+        for (const auto &group : groups)
+        {
+            GLint format = get<0>(group.first), width = get<1>(group.first), height = get<2>(group.first);
+            for (size_t first = 0; first < group.second.size(); first += maxLayers)
+            {
+                vector<size_t> members(group.second.begin() + first,
+                                       group.second.begin() + std::min(group.second.size(), first + (size_t)maxLayers));
+                unsigned int array = 0;
+                glGenTextures(1, &array);
+                GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, array);
+                size_t arrayBytes = format == GL_RGBA8
+                                        ? fillResampled(array, width, members, textures, framebuffers)
+                                        : fillCompressed(array, format, width, height, members, textures, levels);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                for (size_t layer = 0; layer < members.size(); layer++)
+                {
+                    Texture &texture = textures[members[layer]];
+                    texture.id = array;
+                    texture.target = GL_TEXTURE_2D_ARRAY;
+                    texture.layer = layer;
+                }
+                arrays.push_back(array);
+                if (bytes)
+                    *bytes += arrayBytes;
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(2, framebuffers);
+        return arrays;
+    }
+
+private:
+    static GLint mipLevels(GLint size)
+    {
+        GLint levels = 1;
+        while (size > 1)
+        {
+            size /= 2;
+            levels++;
+        }
+        return levels;
+    }
+
+    // blits every member into its layer, scaling with linear filtering, then builds the mip chain
+    static size_t fillResampled(unsigned int array, GLint size, const vector<size_t> &members,
+                                const vector<Texture> &textures, const GLuint framebuffers[2])
+    {
+        GLint levels = mipLevels(size);
+        for (GLint level = 0, levelSize = size; level < levels; level++, levelSize = std::max(1, levelSize / 2))
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelSize, levelSize, members.size(), 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, nullptr);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+        for (size_t layer = 0; layer < members.size(); layer++)
+        {
+            const Texture &texture = textures[members[layer]];
+            GLint width = 0, height = 0;
+            GLState::Get().BindTexture(GL_TEXTURE_2D, texture.id);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0)
+                continue;
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.id, 0);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, layer);
+            if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE
+                || glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                cout << "ERROR::TEXTURE_ARRAY::FRAMEBUFFER_INCOMPLETE: " << texture.path << endl;
+                continue;
+            }
+            glBlitFramebuffer(0, 0, width, height, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        return (size_t)size * size * 4 * members.size() * 4 / 3;
+    }
+
+    // copies the compressed blocks of every member, level by level; the array keeps as many
+    // levels as the member with the fewest
+    static size_t fillCompressed(unsigned int array, GLint format, GLint width, GLint height,
+                                 const vector<size_t> &members, const vector<Texture> &textures, const vector<GLint> &levels)
+    {
+        GLint arrayLevels = levels[members[0]];
+        for (size_t member : members)
+            arrayLevels = std::min(arrayLevels, levels[member]);
+
+        size_t bytes = 0;
+        vector<unsigned char> blocks;
+        for (GLint level = 0; level < arrayLevels; level++)
+        {
+            GLint levelWidth = std::max(1, width >> level), levelHeight = std::max(1, height >> level);
+            GLint layerBytes = 0;
+            GLState::Get().BindTexture(GL_TEXTURE_2D, textures[members[0]].id);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &layerBytes);
+            GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, array);
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, levelWidth, levelHeight, members.size(), 0,
+                                   layerBytes * members.size(), nullptr);
+            blocks.resize(layerBytes);
+            for (size_t layer = 0; layer < members.size(); layer++)
+            {
+                GLState::Get().BindTexture(GL_TEXTURE_2D, textures[members[layer]].id);
+                glGetCompressedTexImage(GL_TEXTURE_2D, level, blocks.data());
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelWidth, levelHeight, 1, format,
+                                          layerBytes, blocks.data());
+            }
+            bytes += (size_t)layerBytes * members.size();
+        }
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, arrayLevels - 1);
+        return bytes;
+    }
+};
+#endif
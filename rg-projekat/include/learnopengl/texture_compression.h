@@ -0,0 +1,568 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+// CPU block compression (BC1/BC3/BC5/BC7) and a minimal DDS reader/writer.
+// Nothing in here needs OpenGL, so the texture_baker tool can run headless.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+enum class BlockFormat {
+    BC1, // RGB, 4 bpp
+    BC3, // RGBA, 8 bpp
+    BC5, // two channels (normal maps), 8 bpp
+    BC7  // high quality RGBA, 8 bpp (mode 6 only)
+};
+
+const char *BlockFormatName(BlockFormat format)
+{
+    switch (format) {
+        case BlockFormat::BC1: return "BC1";
+        case BlockFormat::BC3: return "BC3";
+        case BlockFormat::BC5: return "BC5";
+        case BlockFormat::BC7: return "BC7";
+    }
+    return "?";
+}
+
+size_t BlockSize(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+// block compressed image with its full mip chain, level 0 first
+struct CompressedImage {
+    BlockFormat format = BlockFormat::BC1;
+    int width = 0;
+    int height = 0;
+    vector<vector<uint8_t>> levels;
+
+    size_t totalBytes() const
+    {
+        size_t bytes = 0;
+        for (const vector<uint8_t> &level : levels)
+            bytes += level.size();
+        return bytes;
+    }
+};
+
+namespace bc {
+
+inline int clampByte(float v)
+{
+    return std::min(255, std::max(0, (int)std::lround(v)));
+}
+
+inline uint16_t pack565(const float c[3])
+{
+    int r = std::min(31, std::max(0, (int)std::lround(c[0] * 31.0f / 255.0f)));
+    int g = std::min(63, std::max(0, (int)std::lround(c[1] * 63.0f / 255.0f)));
+    int b = std::min(31, std::max(0, (int)std::lround(c[2] * 31.0f / 255.0f)));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpack565(uint16_t c, int out[3])
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// finds the two extremes of the block's colours along their principal axis. channels of
+// pixels are read with the given stride, so the same code serves RGB and RGBA.
+inline void principalEndpoints(const uint8_t *pixels, int channels, float lo[4], float hi[4])
+{
+    float mean[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+            mean[c] += pixels[i * 4 + c] / 16.0f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                cov[a][b] += (pixels[i * 4 + a] - mean[a]) * (pixels[i * 4 + b] - mean[b]);
+
+    // power iteration, starting from the largest diagonal entry
+    float axis[4] = {0, 0, 0, 0};
+    int largest = 0;
+    for (int c = 1; c < channels; c++)
+        if (cov[c][c] > cov[largest][largest])
+            largest = c;
+    axis[largest] = 1.0f;
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {0, 0, 0, 0};
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                next[a] += cov[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f)
+            break;
+        length = std::sqrt(length);
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (pixels[i * 4 + c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    for (int c = 0; c < channels; c++)
+    {
+        lo[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minT));
+        hi[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maxT));
+    }
+}
+
+// BC1 colour block from 16 RGBA pixels (alpha ignored), always in 4 colour mode
+inline void encodeBC1(const uint8_t *pixels, uint8_t *out)
+{
+    float lo[4], hi[4];
+    principalEndpoints(pixels, 3, lo, hi);
+    uint16_t c0 = pack565(hi), c1 = pack565(lo);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        int p0[3], p1[3];
+        unpack565(c0, p0);
+        unpack565(c1, p1);
+        int palette[4][3];
+        for (int c = 0; c < 3; c++)
+        {
+            palette[0][c] = p0[c];
+            palette[1][c] = p1[c];
+            palette[2][c] = (2 * p0[c] + p1[c]) / 3;
+            palette[3][c] = (p0[c] + 2 * p1[c]) / 3;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = INT32_MAX;
+            for (int p = 0; p < 4; p++)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    int d = pixels[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+// BC4 single channel block, used for BC3 alpha and both BC5 channels. channel selects the
+// byte of each RGBA pixel to encode.
+inline void encodeBC4(const uint8_t *pixels, int channel, uint8_t *out)
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        lo = std::min(lo, (int)pixels[i * 4 + channel]);
+        hi = std::max(hi, (int)pixels[i * 4 + channel]);
+    }
+    out[0] = hi;
+    out[1] = lo;
+
+    uint64_t indices = 0;
+    if (hi != lo)
+    {
+        // 8 value mode (a0 > a1): 0 -> a0, 1 -> a1, 2..7 -> interpolated from a0 towards a1
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = INT32_MAX;
+            for (int p = 0; p < 8; p++)
+            {
+                int error = std::abs(pixels[i * 4 + channel] - palette[p]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+// writes count bits of value into a 128 bit block, LSB first
+inline void putBits(uint8_t *block, int &position, uint32_t value, int count)
+{
+    for (int i = 0; i < count; i++, position++)
+        if (value & (1u << i))
+            block[position >> 3] |= 1 << (position & 7);
+}
+
+// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4 bit indices
+inline void encodeBC7(const uint8_t *pixels, uint8_t *out)
+{
+    static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    float lo[4], hi[4];
+    principalEndpoints(pixels, 4, lo, hi);
+
+    // quantize each endpoint to 7 bits per channel with the shared p-bit that fits it best
+    int endpoints[2][4], pbits[2];
+    const float *targets[2] = {lo, hi};
+    for (int e = 0; e < 2; e++)
+    {
+        int bestError = INT32_MAX;
+        for (int p = 0; p < 2; p++)
+        {
+            int quantized[4], error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                quantized[c] = std::min(127, std::max(0, (int)std::lround((targets[e][c] - p) / 2.0f)));
+                int d = ((quantized[c] << 1) | p) - clampByte(targets[e][c]);
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbits[e] = p;
+                std::copy(quantized, quantized + 4, endpoints[e]);
+            }
+        }
+    }
+
+    int palette[16][4];
+    for (int w = 0; w < 16; w++)
+        for (int c = 0; c < 4; c++)
+        {
+            int e0 = (endpoints[0][c] << 1) | pbits[0];
+            int e1 = (endpoints[1][c] << 1) | pbits[1];
+            palette[w][c] = ((64 - weights[w]) * e0 + weights[w] * e1 + 32) >> 6;
+        }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, bestError = INT32_MAX;
+        for (int w = 0; w < 16; w++)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                int d = pixels[i * 4 + c] - palette[w][c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best = w;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // the anchor index is stored with its top bit implied zero, swap endpoints if needed
+    if (indices[0] & 8)
+    {
+        for (int c = 0; c < 4; c++)
+            std::swap(endpoints[0][c], endpoints[1][c]);
+        std::swap(pbits[0], pbits[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    std::memset(out, 0, 16);
+    int position = 0;
+    putBits(out, position, 1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        putBits(out, position, endpoints[0][c], 7);
+        putBits(out, position, endpoints[1][c], 7);
+    }
+    putBits(out, position, pbits[0], 1);
+    putBits(out, position, pbits[1], 1);
+    putBits(out, position, indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        putBits(out, position, indices[i], 4);
+}
+
+// compresses one RGBA8 mip level
+inline vector<uint8_t> compressLevel(const vector<uint8_t> &rgba, int width, int height, BlockFormat format)
+{
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    vector<uint8_t> result(blocksX * blocksY * BlockSize(format));
+    uint8_t block[16 * 4];
+    uint8_t *out = result.data();
+    for (int by = 0; by < blocksY; by++)
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            // gather the 4x4 block, clamping at the edges of levels smaller than a block
+            for (int y = 0; y < 4; y++)
+                for (int x = 0; x < 4; x++)
+                {
+                    int sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);
+                    std::memcpy(block + (y * 4 + x) * 4, &rgba[(sy * width + sx) * 4], 4);
+                }
+            switch (format) {
+                case BlockFormat::BC1:
+                    encodeBC1(block, out);
+                    break;
+                case BlockFormat::BC3:
+                    encodeBC4(block, 3, out);
+                    encodeBC1(block, out + 8);
+                    break;
+                case BlockFormat::BC5:
+                    encodeBC4(block, 0, out);
+                    encodeBC4(block, 1, out + 8);
+                    break;
+                case BlockFormat::BC7:
+                    encodeBC7(block, out);
+                    break;
+            }
+            out += BlockSize(format);
+        }
+    return result;
+}
+
+// 2x2 box filter, odd edges repeat the last texel
+inline vector<uint8_t> downsample(const vector<uint8_t> &rgba, int width, int height, int &newWidth, int &newHeight)
+{
+    newWidth = std::max(1, width / 2);
+    newHeight = std::max(1, height / 2);
+    vector<uint8_t> result(newWidth * newHeight * 4);
+    for (int y = 0; y < newHeight; y++)
+        for (int x = 0; x < newWidth; x++)
+        {
+            int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int c = 0; c < 4; c++)
+                result[(y * newWidth + x) * 4 + c] = (rgba[(y0 * width + x0) * 4 + c] + rgba[(y0 * width + x1) * 4 + c]
+                                                      + rgba[(y1 * width + x0) * 4 + c] + rgba[(y1 * width + x1) * 4 + c] + 2) / 4;
+        }
+    return result;
+}
+
+} // namespace bc
+
+// compresses 8 bit pixels with 1-4 components into format, generating the whole mip chain on the CPU
+CompressedImage CompressImage(const unsigned char *pixels, int width, int height, int nrComponents, BlockFormat format)
+{
+    vector<uint8_t> rgba(width * height * 4);
+    for (int i = 0; i < width * height; i++)
+    {
+        const unsigned char *p = pixels + i * nrComponents;
+        uint8_t *q = &rgba[i * 4];
+        if (nrComponents >= 3)
+        {
+            q[0] = p[0];
+            q[1] = p[1];
+            q[2] = p[2];
+        }
+        else
+            q[0] = q[1] = q[2] = p[0];
+        q[3] = nrComponents == 4 ? p[3] : nrComponents == 2 ? p[1] : 255;
+    }
+
+    CompressedImage image;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    int levelWidth = width, levelHeight = height;
+    for (;;)
+    {
+        image.levels.push_back(bc::compressLevel(rgba, levelWidth, levelHeight, format));
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        rgba = bc::downsample(rgba, levelWidth, levelHeight, levelWidth, levelHeight);
+    }
+    return image;
+}
+
+// how far, in 8 bit steps, a channel may stray from the mean for UniformColor to still call the
+// image one color; JPEG leaves a little ringing even in flat swatches
+const int UNIFORM_COLOR_TOLERANCE = 3;
+
+// true if every pixel of the image is within UNIFORM_COLOR_TOLERANCE of a single color, which is
+// returned in rgba (0..1, expanded like CompressImage does). Such images (color_R-G-B.jpg swatches,
+// default-grey.jpg placeholders) are better drawn with a constant than sampled from a texture.
+bool UniformColor(const unsigned char *pixels, int width, int height, int nrComponents, float rgba[4])
+{
+    if (!pixels || width <= 0 || height <= 0)
+        return false;
+    int low[4] = {255, 255, 255, 255}, high[4] = {0, 0, 0, 0};
+    double sum[4] = {0.0, 0.0, 0.0, 0.0};
+    size_t count = (size_t)width * height;
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *p = pixels + i * nrComponents;
+        int texel[4] = {p[0], p[0], p[0], 255};
+        if (nrComponents >= 3)
+        {
+            texel[1] = p[1];
+            texel[2] = p[2];
+        }
+        if (nrComponents == 4 || nrComponents == 2)
+            texel[3] = p[nrComponents - 1];
+        for (int c = 0; c < 4; c++)
+        {
+            low[c] = std::min(low[c], texel[c]);
+            high[c] = std::max(high[c], texel[c]);
+            sum[c] += texel[c];
+        }
+    }
+    for (int c = 0; c < 4; c++)
+    {
+        float mean = (float)(sum[c] / count);
+        if (mean - low[c] > UNIFORM_COLOR_TOLERANCE || high[c] - mean > UNIFORM_COLOR_TOLERANCE)
+            return false;
+        rgba[c] = mean / 255.0f;
+    }
+    return true;
+}
+
+// DDS container, see "Programming Guide for DDS" in the DirectX docs. BC1/BC3 use the legacy
+// DXT1/DXT5 FourCC, BC5/BC7 the DX10 extension header.
+namespace dds {
+
+const uint32_t MAGIC = 0x20534444; // "DDS "
+const uint32_t DX10 = 0x30315844;  // "DX10"
+const uint32_t DXT1 = 0x31545844;
+const uint32_t DXT5 = 0x35545844;
+const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+
+struct PixelFormat {
+    uint32_t size, flags, fourCC, rgbBitCount, rBitMask, gBitMask, bBitMask, aBitMask;
+};
+
+struct Header {
+    uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+    uint32_t reserved1[11];
+    PixelFormat pixelFormat;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+struct HeaderDX10 {
+    uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+};
+
+} // namespace dds
+
+bool WriteDDS(const string &path, const CompressedImage &image)
+{
+    dds::Header header;
+    std::memset(&header, 0, sizeof(header));
+    header.size = sizeof(dds::Header);
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixelformat, mipmapcount, linearsize
+    header.height = image.height;
+    header.width = image.width;
+    header.pitchOrLinearSize = image.levels.empty() ? 0 : image.levels[0].size();
+    header.mipMapCount = image.levels.size();
+    header.pixelFormat.size = sizeof(dds::PixelFormat);
+    header.pixelFormat.flags = 0x4; // fourcc
+    header.caps = 0x1000 | 0x400000 | 0x8; // texture, mipmap, complex
+
+    dds::HeaderDX10 dx10 = {0, 3, 0, 1, 0}; // texture 2D
+    switch (image.format) {
+        case BlockFormat::BC1: header.pixelFormat.fourCC = dds::DXT1; break;
+        case BlockFormat::BC3: header.pixelFormat.fourCC = dds::DXT5; break;
+        case BlockFormat::BC5: header.pixelFormat.fourCC = dds::DX10; dx10.dxgiFormat = dds::DXGI_FORMAT_BC5_UNORM; break;
+        case BlockFormat::BC7: header.pixelFormat.fourCC = dds::DX10; dx10.dxgiFormat = dds::DXGI_FORMAT_BC7_UNORM; break;
+    }
+
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out)
+        return false;
+    out.write((const char *)&dds::MAGIC, 4);
+    out.write((const char *)&header, sizeof(header));
+    if (header.pixelFormat.fourCC == dds::DX10)
+        out.write((const char *)&dx10, sizeof(dx10));
+    for (const vector<uint8_t> &level : image.levels)
+        out.write((const char *)level.data(), level.size());
+    return (bool)out;
+}
+
+// reads a DDS written by WriteDDS (or any 2D BC1/BC3/BC5/BC7 DDS with a mip chain) from memory
+bool ReadDDS(const unsigned char *data, size_t size, CompressedImage &image)
+{
+    if (size < 4 + sizeof(dds::Header))
+        return false;
+    uint32_t magic;
+    dds::Header header;
+    std::memcpy(&magic, data, 4);
+    std::memcpy(&header, data + 4, sizeof(header));
+    if (magic != dds::MAGIC || header.size != sizeof(dds::Header) || header.width == 0 || header.height == 0)
+        return false;
+
+    size_t offset = 4 + sizeof(dds::Header);
+    switch (header.pixelFormat.fourCC) {
+        case dds::DXT1: image.format = BlockFormat::BC1; break;
+        case dds::DXT5: image.format = BlockFormat::BC3; break;
+        case dds::DX10:
+        {
+            if (size < offset + sizeof(dds::HeaderDX10))
+                return false;
+            dds::HeaderDX10 dx10;
+            std::memcpy(&dx10, data + offset, sizeof(dx10));
+            offset += sizeof(dx10);
+            if (dx10.dxgiFormat == dds::DXGI_FORMAT_BC5_UNORM)
+                image.format = BlockFormat::BC5;
+            else if (dx10.dxgiFormat == dds::DXGI_FORMAT_BC7_UNORM)
+                image.format = BlockFormat::BC7;
+            else
+                return false;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    image.width = header.width;
+    image.height = header.height;
+    image.levels.clear();
+    uint32_t levels = std::max(1u, header.mipMapCount);
+    int width = image.width, height = image.height;
+    for (uint32_t i = 0; i < levels; i++)
+    {
+        size_t bytes = (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockSize(image.format);
+        if (offset + bytes > size)
+            return false;
+        image.levels.emplace_back(data + offset, data + offset + bytes);
+        offset += bytes;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return true;
+}
+#endif
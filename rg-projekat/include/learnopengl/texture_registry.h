@@ -0,0 +1,429 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/texture_compression.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// pixels of an image decoded by stb_image, not yet uploaded to the GPU
+struct DecodedImage {
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    int nrComponents = 0;
+};
+
+// decodes an image file into memory. Only touches the CPU, so it can run on any thread.
+DecodedImage DecodeImage(const string &filename)
+{
+    DecodedImage image;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    return image;
+}
+
+// uploads a decoded image as a mipmapped 2D texture and frees its pixels. Needs the GL context.
+unsigned int TextureFromImage(DecodedImage &image, const string &filename, bool gamma = false)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    if (image.data)
+    {
+        GLenum format;
+        if (image.nrComponents == 1)
+            format = GL_RED;
+        else if (image.nrComponents == 3)
+            format = GL_RGB;
+        else if (image.nrComponents == 4)
+            format = GL_RGBA;
+
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        stbi_image_free(image.data);
+        image.data = nullptr;
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << filename << std::endl;
+    }
+
+    return textureID;
+}
+
+// the core 3.3 glad loader has no S3TC/BPTC enums
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+GLenum CompressedInternalFormat(BlockFormat format)
+{
+    switch (format) {
+        case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    return 0;
+}
+
+// uploads a baked block compressed image with its precomputed mip chain. Needs the GL context.
+unsigned int TextureFromCompressed(const CompressedImage &image)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
+
+    GLenum internalFormat = CompressedInternalFormat(image.format);
+    int width = image.width, height = image.height;
+    for (size_t level = 0; level < image.levels.size(); level++)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0,
+                               image.levels[level].size(), image.levels[level].data());
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return textureID;
+}
+
+// an image file on its way into the registry, see TextureRegistry::Prepare
+struct TextureSource {
+    string filename;
+    string canonicalPath;
+    uint64_t hash = 0;
+    bool resident = false; // already on the GPU, nothing was decoded
+    DecodedImage image;
+    bool isCompressed = false; // baked <filename>.dds was loaded into compressed instead of image
+    CompressedImage compressed;
+    bool isConstant = false; // a single color, nothing to upload (image keeps only its size)
+    glm::vec4 color = glm::vec4(1.0f);
+};
+
+// Process wide registry of 2D textures, so every image is decoded and resident on the GPU once,
+// no matter how many models reference it. Entries are found in O(1) by canonical path and,
+// for identical files in different folders (e.g. default-grey.jpg of every car), by content
+// hash. An image acquired both with and without gamma correction gets one texture of each. Each
+// Acquire must be paired with a Release; the GL texture is deleted with the last one.
+// Images of a single color are never uploaded: Prepare marks them constant and Acquire returns 0,
+// the caller draws them with the color instead.
+class TextureRegistry {
+public:
+    static TextureRegistry &Instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // checks which block compressed formats the driver takes. Call once on the GL thread after
+    // the context is created; until then baked .dds files are ignored.
+    void DetectCompressionSupport()
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        bool s3tc = false, bptc = false;
+        for (GLint i = 0; i < count; i++)
+        {
+            const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+                s3tc = true;
+            else if (strcmp(extension, "GL_ARB_texture_compression_bptc") == 0)
+                bptc = true;
+        }
+        lock_guard<mutex> lock(registryMutex);
+        compressionSupported[(int)BlockFormat::BC1] = s3tc;
+        compressionSupported[(int)BlockFormat::BC3] = s3tc;
+        compressionSupported[(int)BlockFormat::BC5] = true; // RGTC is core since 3.0
+        compressionSupported[(int)BlockFormat::BC7] = bptc;
+    }
+
+    // CPU half of loading a texture, safe to call from worker threads: resolves the canonical
+    // path, hashes the file and decodes it only if no resident texture has that path or content.
+    // A baked <filename>.dds newer than the source is used instead of decoding when supported.
+    // Decoded images of one color (see UniformColor) come back constant, without pixels.
+    TextureSource Prepare(const string &filename)
+    {
+        TextureSource source;
+        source.filename = filename;
+        source.canonicalPath = canonicalize(filename);
+        {
+            lock_guard<mutex> lock(registryMutex);
+            auto byPath = paths.find(source.canonicalPath);
+            if (byPath != paths.end())
+            {
+                source.hash = byPath->second;
+                source.resident = true;
+                return source;
+            }
+        }
+
+        MappedFile file(filename);
+        if (!file.data)
+            return source;
+        source.hash = MeshCache::hashBytes(file.data, file.size);
+        {
+            lock_guard<mutex> lock(registryMutex);
+            if (hasContent(source.hash))
+            {
+                source.resident = true;
+                return source;
+            }
+        }
+        if (loadBaked(source))
+            return source;
+        if (file.size <= INT_MAX)
+            source.image.data = stbi_load_from_memory(file.data, file.size, &source.image.width, &source.image.height,
+                                                      &source.image.nrComponents, 0);
+        float rgba[4];
+        if (UniformColor(source.image.data, source.image.width, source.image.height, source.image.nrComponents, rgba))
+        {
+            stbi_image_free(source.image.data);
+            source.image.data = nullptr;
+            source.isConstant = true;
+            source.color = glm::vec4(rgba[0], rgba[1], rgba[2], rgba[3]);
+        }
+        return source;
+    }
+
+    // GL half: returns the texture for source, uploading its pixels if it is not resident yet, or
+    // 0 for a constant source
+    unsigned int Acquire(TextureSource &source, bool gamma = false)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        stats.requests++;
+        if (source.isConstant)
+        {
+            stats.constants++;
+            stats.bytesSaved += residentBytes(source.image);
+            return 0;
+        }
+
+        bool loaded = source.image.data || source.isCompressed;
+        auto existing = loaded || source.resident ? entries.find(EntryKey{source.hash, gamma}) : entries.end();
+        if (existing != entries.end())
+        {
+            Entry &entry = existing->second;
+            if (paths.count(source.canonicalPath))
+                stats.pathHits++;
+            else
+                stats.contentHits++;
+            paths[source.canonicalPath] = source.hash;
+            entry.references++;
+            stats.bytesSaved += entry.bytes;
+            if (loaded)
+            {
+                // another worker decoded the same content concurrently
+                stbi_image_free(source.image.data);
+                source.image.data = nullptr;
+                source.compressed = CompressedImage();
+            }
+            else
+                stats.decodesSkipped++;
+            return entry.id;
+        }
+
+        if (!loaded && source.resident)
+        {
+            // was resident when prepared but got released since
+            source.image = DecodeImage(source.filename);
+            if (source.image.data)
+                source.hash = MeshCache::hashFile(source.filename);
+        }
+        if (!source.image.data && !source.isCompressed)
+        {
+            // unreadable file, keep the old behaviour of returning an empty texture object
+            DecodedImage empty;
+            return TextureFromImage(empty, source.filename, gamma);
+        }
+
+        Entry entry;
+        if (source.isCompressed)
+        {
+            entry.bytes = source.compressed.totalBytes();
+            entry.id = TextureFromCompressed(source.compressed);
+            source.compressed = CompressedImage();
+            stats.compressedUploads++;
+        }
+        else
+        {
+            entry.bytes = residentBytes(source.image);
+            entry.id = TextureFromImage(source.image, source.filename, gamma);
+        }
+        entry.references = 1;
+        entries[EntryKey{source.hash, gamma}] = entry;
+        ids[entry.id] = EntryKey{source.hash, gamma};
+        paths[source.canonicalPath] = source.hash;
+        stats.uploads++;
+        stats.bytesResident += entry.bytes;
+        return entry.id;
+    }
+
+    // loads filename on the calling thread, which must own the GL context
+    unsigned int Acquire(const string &filename, bool gamma = false)
+    {
+        TextureSource source = Prepare(filename);
+        return Acquire(source, gamma);
+    }
+
+    void Release(unsigned int id)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        auto byId = ids.find(id);
+        if (byId == ids.end())
+            return;
+        auto entry = entries.find(byId->second);
+        if (--entry->second.references > 0)
+            return;
+
+        GLState::Get().DeleteTexture(id);
+        stats.bytesResident -= entry->second.bytes;
+        uint64_t hash = byId->second.hash;
+        entries.erase(entry);
+        ids.erase(byId);
+        // the paths still lead to the content while it is resident with the other gamma
+        if (hasContent(hash))
+            return;
+        for (auto path = paths.begin(); path != paths.end();)
+        {
+            if (path->second == hash)
+                path = paths.erase(path);
+            else
+                ++path;
+        }
+    }
+
+    void PrintStats(ostream &out = cout)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        out << "TEXTURE_REGISTRY:: " << stats.requests << " requests, " << stats.uploads << " uploads ("
+            << stats.compressedUploads << " block compressed, "
+            << entries.size() << " resident, " << stats.bytesResident / (1024.0 * 1024.0) << " MB), "
+            << stats.pathHits << " path hits, " << stats.contentHits << " content hits, "
+            << stats.decodesSkipped << " decodes skipped, " << stats.constants << " solid colors not uploaded, "
+            << stats.bytesSaved / (1024.0 * 1024.0) << " MB of VRAM saved" << endl;
+    }
+
+private:
+    struct Entry {
+        unsigned int id = 0;
+        unsigned int references = 0;
+        size_t bytes = 0;
+    };
+
+    // the same content uploaded with and without gamma correction are two textures
+    struct EntryKey {
+        uint64_t hash;
+        bool gamma;
+
+        bool operator==(const EntryKey &other) const
+        {
+            return hash == other.hash && gamma == other.gamma;
+        }
+    };
+
+    struct EntryKeyHash {
+        size_t operator()(const EntryKey &key) const
+        {
+            return key.hash ^ (size_t)key.gamma;
+        }
+    };
+
+    struct Stats {
+        size_t requests = 0;
+        size_t uploads = 0;
+        size_t compressedUploads = 0;
+        size_t pathHits = 0;
+        size_t contentHits = 0;
+        size_t decodesSkipped = 0;
+        size_t constants = 0;
+        size_t bytesResident = 0;
+        size_t bytesSaved = 0;
+    };
+
+    mutex registryMutex;
+    unordered_map<EntryKey, Entry, EntryKeyHash> entries; // content hash and gamma -> texture
+    unordered_map<string, uint64_t> paths;                // canonical path -> content hash
+    unordered_map<unsigned int, EntryKey> ids;            // GL name -> entry
+    Stats stats;
+    bool compressionSupported[4] = {false, false, false, false};
+
+    TextureRegistry() = default;
+
+    // resident with either gamma, so Prepare need not decode it; Acquire decodes again if needed
+    bool hasContent(uint64_t hash) const
+    {
+        return entries.count(EntryKey{hash, false}) || entries.count(EntryKey{hash, true});
+    }
+
+    bool loadBaked(TextureSource &source)
+    {
+        string baked = source.filename + ".dds";
+        struct stat sourceStat, bakedStat;
+        if (stat(source.filename.c_str(), &sourceStat) != 0 || stat(baked.c_str(), &bakedStat) != 0
+            || bakedStat.st_mtime < sourceStat.st_mtime)
+            return false;
+
+        MappedFile file(baked);
+        CompressedImage image;
+        if (!file.data || !ReadDDS(file.data, file.size, image))
+            return false;
+        {
+            lock_guard<mutex> lock(registryMutex);
+            if (!compressionSupported[(int)image.format])
+                return false;
+        }
+        source.compressed = std::move(image);
+        source.isCompressed = true;
+        return true;
+    }
+
+    static string canonicalize(const string &filename)
+    {
+        char *resolved = realpath(filename.c_str(), nullptr);
+        if (!resolved)
+            return filename;
+        string canonical(resolved);
+        free(resolved);
+        return canonical;
+    }
+
+    // estimate of what the driver keeps: RGB is padded to RGBA, plus a third for the mip chain
+    static size_t residentBytes(const DecodedImage &image)
+    {
+        size_t texel = image.nrComponents == 1 ? 1 : 4;
+        return (size_t)image.width * image.height * texel * 4 / 3;
+    }
+};
+#endif
@@ -0,0 +1,220 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+};
+
+// layout of a mesh's vertex buffer, chosen per model
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT,  // Vertex as is, 56 bytes
+    VERTEX_FORMAT_PACKED  // PackedVertex, 20 bytes
+};
+
+// Quantized vertex for VERTEX_FORMAT_PACKED:
+//  - position as 16 bit unsigned normalized within the model bounds, the vertex shader scales
+//    it back with positionScale/positionOffset
+//  - normal and tangent as GL_INT_2_10_10_10_REV, x/y/z signed normalized, which the vertex
+//    fetch converts without any decoding in the shader; the tangent's w holds the handedness,
+//    the bitangent is cross(normal, tangent) * w
+//  - texture coordinates as half floats
+struct PackedVertex {
+    uint16_t Position[4]; // w unused
+    uint32_t Normal;
+    uint32_t Tangent;
+    uint16_t TexCoords[2];
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex layout");
+
+// vertex attribute locations, as the shaders declare them
+enum VertexAttribute {
+    ATTRIBUTE_POSITION,
+    ATTRIBUTE_NORMAL,
+    ATTRIBUTE_TEX_COORDS,
+    ATTRIBUTE_TANGENT,
+    ATTRIBUTE_BITANGENT,
+    VERTEX_ATTRIBUTE_COUNT
+};
+const unsigned int VERTEX_ATTRIBUTES_ALL = (1u << VERTEX_ATTRIBUTE_COUNT) - 1;
+
+// How the vertices of a mesh are laid out in a vertex buffer: the format plus the subset of
+// attributes stored, interleaved in VertexAttribute order.
+class VertexLayout {
+public:
+    VertexFormat format;
+    unsigned int attributes; // bit per VertexAttribute
+    unsigned int stride = 0;
+
+    explicit VertexLayout(VertexFormat format = VERTEX_FORMAT_FLOAT, unsigned int attributes = VERTEX_ATTRIBUTES_ALL)
+        : format(format), attributes(attributes)
+    {
+        for (unsigned int attribute = 0; attribute < VERTEX_ATTRIBUTE_COUNT; attribute++)
+        {
+            offsets[attribute] = stride;
+            if (stored(attribute))
+                stride += stream(format, attribute).size;
+        }
+    }
+
+    // Appends vertices in this layout to out. Packed positions are quantized to the box
+    // [positionOffset, positionOffset + positionScale], which the vertex shader scales back.
+    void Append(const vector<Vertex> &vertices, const glm::vec3 &positionScale, const glm::vec3 &positionOffset,
+                vector<unsigned char> &out) const
+    {
+        vector<PackedVertex> packed;
+        const unsigned char *source = (const unsigned char *)vertices.data();
+        size_t sourceStride = sizeof(Vertex);
+        if (format == VERTEX_FORMAT_PACKED)
+        {
+            packed = pack(vertices, positionScale, positionOffset);
+            source = (const unsigned char *)packed.data();
+            sourceStride = sizeof(PackedVertex);
+        }
+
+        size_t base = out.size();
+        out.resize(base + vertices.size() * stride);
+        for (size_t i = 0; i < vertices.size(); i++)
+            for (unsigned int attribute = 0; attribute < VERTEX_ATTRIBUTE_COUNT; attribute++)
+                if (stored(attribute))
+                {
+                    const VertexStream &from = stream(format, attribute);
+                    memcpy(&out[base + i * stride + offsets[attribute]], source + i * sourceStride + from.offset, from.size);
+                }
+    }
+
+    // points the bound vertex array at the bound GL_ARRAY_BUFFER. Attributes left out read the
+    // default (0, 0, 0, 1).
+    void SetupAttributes() const
+    {
+        for (unsigned int attribute = 0; attribute < VERTEX_ATTRIBUTE_COUNT; attribute++)
+        {
+            if (!stored(attribute))
+                continue;
+            const VertexStream &from = stream(format, attribute);
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribPointer(attribute, from.components, from.type, from.normalized, stride,
+                                  (void*)(size_t)offsets[attribute]);
+        }
+    }
+
+private:
+    unsigned int offsets[VERTEX_ATTRIBUTE_COUNT];
+
+    // where an attribute lives in Vertex or PackedVertex and how GL reads it. size 0 means the
+    // format does not store it.
+    struct VertexStream {
+        GLint components;
+        GLenum type;
+        GLboolean normalized;
+        unsigned int offset;
+        unsigned int size;
+    };
+
+    static const VertexStream &stream(VertexFormat format, unsigned int attribute)
+    {
+        static const VertexStream floatStreams[VERTEX_ATTRIBUTE_COUNT] = {
+            {3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position), sizeof(glm::vec3)},
+            {3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal), sizeof(glm::vec3)},
+            {2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords), sizeof(glm::vec2)},
+            {3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent), sizeof(glm::vec3)},
+            {3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Bitangent), sizeof(glm::vec3)},
+        };
+        // packed types always have 4 components, the shader ignores w where it declares a vec3
+        static const VertexStream packedStreams[VERTEX_ATTRIBUTE_COUNT] = {
+            {3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, Position), 4 * sizeof(uint16_t)},
+            {4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, Normal), sizeof(uint32_t)},
+            {2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, TexCoords), 2 * sizeof(uint16_t)},
+            {4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, Tangent), sizeof(uint32_t)},
+            {0, GL_NONE, GL_FALSE, 0, 0}, // derived from normal and tangent
+        };
+        return format == VERTEX_FORMAT_PACKED ? packedStreams[attribute] : floatStreams[attribute];
+    }
+
+    bool stored(unsigned int attribute) const
+    {
+        return (attributes & (1u << attribute)) && stream(format, attribute).size > 0;
+    }
+
+    static vector<PackedVertex> pack(const vector<Vertex> &vertices, const glm::vec3 &positionScale,
+                                     const glm::vec3 &positionOffset)
+    {
+        vector<PackedVertex> packed(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const Vertex &vertex = vertices[i];
+            PackedVertex &out = packed[i];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float t = positionScale[axis] > 0.0f ? (vertex.Position[axis] - positionOffset[axis]) / positionScale[axis] : 0.0f;
+                out.Position[axis] = (uint16_t)std::lround(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f);
+            }
+            out.Position[3] = 0;
+            float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            out.Normal = packSnorm10(vertex.Normal, 0.0f);
+            out.Tangent = packSnorm10(vertex.Tangent, handedness);
+            out.TexCoords[0] = packHalf(vertex.TexCoords.x);
+            out.TexCoords[1] = packHalf(vertex.TexCoords.y);
+        }
+        return packed;
+    }
+
+    // x/y/z in [-1, 1] to 10 bit signed components, w (-1, 0 or 1) to the 2 bit one
+    static uint32_t packSnorm10(const glm::vec3 &v, float w)
+    {
+        uint32_t packed = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            int component = (int)std::lround(std::min(std::max(v[i], -1.0f), 1.0f) * 511.0f);
+            packed |= ((uint32_t)component & 0x3ffu) << (10 * i);
+        }
+        packed |= ((uint32_t)(int)w & 0x3u) << 30;
+        return packed;
+    }
+
+    // IEEE 754 half, rounded to nearest; out of range values become infinity, tiny ones denormals or zero
+    static uint16_t packHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        int exponent = (int)((bits >> 23) & 0xffu) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffffu;
+        if (((bits >> 23) & 0xffu) == 0xffu) // infinity and NaN
+            return sign | 0x7c00u | (mantissa ? 0x200u : 0u);
+        if (exponent >= 31)
+            return sign | 0x7c00u;
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return sign;
+            mantissa |= 0x800000u;
+            int shift = 14 - exponent;
+            return sign | ((mantissa + (1u << (shift - 1))) >> shift);
+        }
+        // a carry out of the mantissa correctly bumps the exponent
+        return sign | ((exponent << 10) + ((mantissa + 0x1000u) >> 13));
+    }
+};
+#endif
@@ -0,0 +1,92 @@
+#version 330 core
+// lighting pass of deferred shading, drawn over the whole viewport: the light without a bounded
+// volume, the directional light, with the same terms as the forward shaders
+
+layout (location = 0) out vec4 FragColor;
+
+struct DirLight{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct PointLight{
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct SpotLight{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// frame-global camera and lights, shared by all programs (see frame_uniforms.h)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    bool blinn;
+    DirLight directional;
+    SpotLight spotlight;
+    PointLight pointLights[2];
+};
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 inverseViewportSize;
+uniform float shininess;
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularTexel);
+
+void main(){
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    // nothing was drawn here, the skybox comes later
+    if (depth == 1.0)
+        discard;
+    vec4 position = inverseViewProjection * vec4(vec3(gl_FragCoord.xy * inverseViewportSize, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+    vec3 albedo = texelFetch(gAlbedo, texel, 0).rgb;
+    vec3 norm = texelFetch(gNormal, texel, 0).xyz;
+    vec3 specularTexel = texelFetch(gSpecular, texel, 0).rgb;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 result = CalcDirLight(directional, norm, viewDir, albedo, specularTexel);
+    FragColor = vec4(result, 1.0);
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularTexel){
+    //ambient
+    vec3 ambient = light.ambient * albedo;
+    //diffuse
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(lightDir, normal), 0.0);
+    vec3 diffuse = light.diffuse * diff * albedo;
+    //specular
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = 0.0f;
+
+    //Blinn-Phong
+    if (blinn) {
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        spec = pow(max(dot(normal, halfwayDir),0.0), shininess);
+    } else {
+        spec = pow(max(dot(viewDir, reflectDir),0.0), shininess);
+    }
+
+    vec3 specular = light.specular * spec * specularTexel;
+
+    return (ambient + diffuse + specular);
+}
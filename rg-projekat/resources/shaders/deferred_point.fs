@@ -0,0 +1,101 @@
+#version 330 core
+// one point or spot light on the G-buffer pixels inside its volume, added to what the other lights
+// left there. The same terms as CalcPointLight and CalcSpotLight of the forward shaders.
+
+layout (location = 0) out vec4 FragColor;
+
+flat in vec4 LightSphere; // position, radius
+flat in vec3 LightAmbient;
+flat in vec3 LightDiffuse;
+flat in vec3 LightSpecular;
+flat in vec4 LightCone; // direction, cosine of the inner cutoff; equal cutoffs for point lights
+flat in float LightOuterCutOff;
+
+struct DirLight{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct PointLight{
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct SpotLight{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// frame-global camera and lights, shared by all programs (see frame_uniforms.h)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    bool blinn;
+    DirLight directional;
+    SpotLight spotlight;
+    PointLight pointLights[2];
+};
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 inverseViewportSize;
+uniform float shininess;
+
+void main(){
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    if (depth == 1.0)
+        discard;
+    vec4 position = inverseViewProjection * vec4(vec3(gl_FragCoord.xy * inverseViewportSize, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+    // the volume's back faces only reject surfaces behind it, not those in front
+    float d = length(LightSphere.xyz - fragPos);
+    if (d > LightSphere.w)
+        discard;
+    vec3 albedo = texelFetch(gAlbedo, texel, 0).rgb;
+    vec3 normal = texelFetch(gNormal, texel, 0).xyz;
+    vec3 specularTexel = texelFetch(gSpecular, texel, 0).rgb;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    //ambient
+    vec3 ambient = LightAmbient * albedo;
+    //diffuse
+    vec3 lightDir = normalize(LightSphere.xyz - fragPos);
+    float diff = max(dot(lightDir, normal), 0.0);
+    vec3 diffuse = LightDiffuse * diff * albedo;
+    //specular
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = 0.0f;
+
+    //Blinn-Phong
+    if(blinn){
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        spec = pow(max(dot(normal, halfwayDir),0.0), shininess);
+    }else{
+        spec = pow(max(dot(viewDir, reflectDir),0.0), shininess);
+    }
+    vec3 specular = LightSpecular * spec * specularTexel;
+
+    //attenuation
+    float att = 1.0/(d*d);
+    //spotlight
+    if (LightCone.w != LightOuterCutOff) {
+        float theta = dot(-lightDir, normalize(LightCone.xyz));
+        att *= clamp((theta - LightOuterCutOff)/(LightCone.w - LightOuterCutOff), 0.0, 1.0);
+    }
+    FragColor = vec4((ambient + diffuse + specular) * att, 1.0);
+}
@@ -0,0 +1,65 @@
+#version 330 core
+// light volumes of deferred shading: one instance of a unit sphere per point or spot light, scaled to
+// the distance where its light falls below DeferredShading::LIGHT_THRESHOLD
+
+layout (location = 0) in vec3 aPos;
+// per light, mirrors LightVolume in deferred_shading.h
+layout (location = 1) in vec4 lightSphere; // position, radius
+layout (location = 2) in vec3 lightAmbient;
+layout (location = 3) in vec3 lightDiffuse;
+layout (location = 4) in vec3 lightSpecular;
+layout (location = 5) in vec4 lightCone; // direction, cosine of the inner cutoff
+layout (location = 6) in float lightOuterCutOff;
+
+flat out vec4 LightSphere;
+flat out vec3 LightAmbient;
+flat out vec3 LightDiffuse;
+flat out vec3 LightSpecular;
+flat out vec4 LightCone;
+flat out float LightOuterCutOff;
+
+struct DirLight{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct PointLight{
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct SpotLight{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// the FrameData block has to be declared exactly as in the fragment shaders
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    bool blinn;
+    DirLight directional;
+    SpotLight spotlight;
+    PointLight pointLights[2];
+};
+
+void main(){
+    LightSphere = lightSphere;
+    LightAmbient = lightAmbient;
+    LightDiffuse = lightDiffuse;
+    LightSpecular = lightSpecular;
+    LightCone = lightCone;
+    LightOuterCutOff = lightOuterCutOff;
+    gl_Position = projection * view * vec4(lightSphere.xyz + aPos * lightSphere.w, 1.0);
+}
@@ -0,0 +1,89 @@
+#version 330 core
+// depth only pre-pass of the scene (see Scene::depthPrepass), compiled with the same MULTI_DRAW
+// and INSTANCED variants as model_loading.vs. gl_Position is invariant and computed with exactly
+// the expressions model_loading.vs uses, so the lit pass finds the same depths and passes GL_LEQUAL
+// on every visible fragment.
+#ifdef MULTI_DRAW
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
+layout (location = 0) in vec3 aPos;
+
+invariant gl_Position;
+
+// the FrameData block has to be declared exactly as in the other shaders
+struct DirLight{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct PointLight{
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct SpotLight{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    bool blinn;
+    DirLight directional;
+    SpotLight spotlight;
+    PointLight pointLights[2];
+};
+
+#ifdef MULTI_DRAW
+// per draw data, mirrors DrawData in multi_draw.h
+struct DrawData {
+    mat4 model;
+    vec4 positionScale;
+    vec4 positionOffset;
+    ivec4 indices; // point light, diffuse layer, specular layer
+    vec4 diffuseColor;
+    vec4 specularColor;
+};
+layout (std430, binding = 0) readonly buffer DrawBuffer {
+    DrawData draws[];
+};
+// first draw of the current glMultiDrawElementsIndirect
+uniform int drawOffset;
+#else
+#ifdef INSTANCED
+// per instance, mirrors ModelInstance in model.h
+layout (location = 5) in mat4 instanceTransform;
+#else
+uniform mat4 model;
+#endif
+// dequantization of packed positions, the defaults leave float positions as they are
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+#endif
+
+void main(){
+#ifdef MULTI_DRAW
+    DrawData draw = draws[drawOffset + gl_DrawIDARB];
+    mat4 model = draw.model;
+    vec3 positionScale = draw.positionScale.xyz;
+    vec3 positionOffset = draw.positionOffset.xyz;
+#elif defined(INSTANCED)
+    mat4 model = instanceTransform;
+#endif
+    vec3 position = positionOffset + aPos * positionScale;
+    vec3 FragPos = vec3(model * vec4(position, 1.0));
+    gl_Position = projection * view * vec4(FragPos,1.0);
+}
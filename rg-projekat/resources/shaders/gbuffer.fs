@@ -0,0 +1,52 @@
+#version 330 core
+// geometry pass of deferred shading (see deferred_shading.h), replaces the fragment shader of
+// every scene shader: the surface goes to the G-buffer, the lights are added later
+
+layout (location = 0) out vec4 gAlbedo;   // diffuse texel
+layout (location = 1) out vec4 gNormal;   // world space
+layout (location = 2) out vec4 gSpecular; // specular texel
+
+// with TEXTURE_ARRAYS the textures are layers of arrays, picked by TextureLayers
+#ifdef TEXTURE_ARRAYS
+struct Material{
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
+};
+#else
+struct Material{
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+};
+#endif
+
+in vec3 Normal;
+in vec2 TexCoords;
+#ifdef INSTANCED
+in vec3 Tint;
+#endif
+
+uniform Material material;
+// single color textures arrive as constants (alpha 1) and are not sampled
+flat in vec4 DiffuseColor;
+flat in vec4 SpecularColor;
+#ifdef TEXTURE_ARRAYS
+flat in ivec2 TextureLayers; // diffuse, specular
+vec3 diffuseTexel(){ return DiffuseColor.a > 0.0 ? DiffuseColor.rgb : texture(material.texture_diffuse1, vec3(TexCoords, TextureLayers.x)).rgb; }
+vec3 specularTexel(){ return SpecularColor.a > 0.0 ? SpecularColor.rgb : texture(material.texture_specular1, vec3(TexCoords, TextureLayers.y)).rgb; }
+#else
+vec3 diffuseTexel(){ return DiffuseColor.a > 0.0 ? DiffuseColor.rgb : texture(material.texture_diffuse1, TexCoords).rgb; }
+vec3 specularTexel(){ return SpecularColor.a > 0.0 ? SpecularColor.rgb : texture(material.texture_specular1, TexCoords).rgb; }
+#endif
+
+void main(){
+    vec3 albedo = diffuseTexel();
+    vec3 specular = specularTexel();
+#ifdef INSTANCED
+    // the lighting is linear in both texels, so this is the forward shaders' result *= Tint
+    albedo *= Tint;
+    specular *= Tint;
+#endif
+    gAlbedo = vec4(albedo, 1.0);
+    gNormal = vec4(normalize(Normal), 1.0);
+    gSpecular = vec4(specular, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+// one level of the Hi-Z pyramid: the farthest depth of the 2x2 texels below, clamped to the
+// edge of odd sized levels, like DepthPyramid::Build
+uniform sampler2D depth; // only the level below is enabled, through the base and max level
+uniform ivec2 belowSize;
+
+void main()
+{
+    ivec2 first = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = min(first + 1, belowSize - 1);
+    float farthest = max(max(texelFetch(depth, first, 0).r, texelFetch(depth, ivec2(last.x, first.y), 0).r),
+                         max(texelFetch(depth, ivec2(first.x, last.y), 0).r, texelFetch(depth, last, 0).r));
+    gl_FragDepth = farthest;
+}
@@ -0,0 +1,21 @@
+#version 330 core
+// level 0 of the Hi-Z pyramid: the farthest occluder depth of the 3x3 texels around, so a texel
+// only occludes where the occluders cover all of it and not just its center. Border texels lack
+// neighbours and stay at the far plane, like DepthPyramid::Build.
+uniform sampler2D depth; // the occluder pass
+uniform ivec2 size;
+
+void main()
+{
+    ivec2 center = ivec2(gl_FragCoord.xy);
+    if (any(equal(center, ivec2(0))) || any(equal(center, size - 1)))
+    {
+        gl_FragDepth = 1.0;
+        return;
+    }
+    float farthest = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+            farthest = max(farthest, texelFetch(depth, center + ivec2(x, y), 0).r);
+    gl_FragDepth = farthest;
+}
@@ -1,4 +1,9 @@
 #version 330 core
+// the multi-draw indirect path compiles this as 4.30 with MULTI_DRAW defined (see render_queue.h),
+// instanced models with INSTANCED defined (see Model::DrawInstanced)
+#ifdef MULTI_DRAW
+#extension GL_ARB_shader_draw_parameters : require
+#endif
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
@@ -8,13 +13,122 @@ out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
+// the same as in depth_prepass.vs, for the lit pass after the depth pre-pass
+invariant gl_Position;
+
+// the FrameData block has to be declared exactly as in the fragment shaders
+struct DirLight{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct PointLight{
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+struct SpotLight{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    bool blinn;
+    DirLight directional;
+    SpotLight spotlight;
+    PointLight pointLights[2];
+};
+
+#ifdef MULTI_DRAW
+// per draw data, mirrors DrawData in multi_draw.h
+struct DrawData {
+    mat4 model;
+    vec4 positionScale;
+    vec4 positionOffset;
+    ivec4 indices; // point light, diffuse layer, specular layer
+    vec4 diffuseColor;
+    vec4 specularColor;
+};
+layout (std430, binding = 0) readonly buffer DrawBuffer {
+    DrawData draws[];
+};
+// first draw of the current glMultiDrawElementsIndirect
+uniform int drawOffset;
+flat out int PointLightIndex;
+#else
+#ifdef INSTANCED
+// per instance, mirrors ModelInstance in model.h
+layout (location = 5) in mat4 instanceTransform;
+layout (location = 9) in vec3 instanceTint;
+layout (location = 10) in int instancePointLight;
+flat out int PointLightIndex;
+out vec3 Tint;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+// dequantization of packed positions, the defaults leave float positions as they are
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+#endif
+
+#ifdef TEXTURE_ARRAYS
+// layers of the diffuse and specular texture in their arrays
+flat out ivec2 TextureLayers;
+#ifndef MULTI_DRAW
+uniform ivec2 textureLayers;
+#endif
+#endif
+
+// constant colors standing in for single color textures, alpha 0 means sample the texture
+flat out vec4 DiffuseColor;
+flat out vec4 SpecularColor;
+#ifndef MULTI_DRAW
+uniform vec4 diffuseColor = vec4(0.0);
+uniform vec4 specularColor = vec4(0.0);
+#endif
 
 void main(){
-    FragPos = vec3(model * vec4(aPos, 1.0));
+#ifdef MULTI_DRAW
+    DrawData draw = draws[drawOffset + gl_DrawIDARB];
+    mat4 model = draw.model;
+    vec3 positionScale = draw.positionScale.xyz;
+    vec3 positionOffset = draw.positionOffset.xyz;
+    PointLightIndex = draw.indices.x;
+#elif defined(INSTANCED)
+    mat4 model = instanceTransform;
+    PointLightIndex = instancePointLight;
+    Tint = instanceTint;
+#endif
+    vec3 position = positionOffset + aPos * positionScale;
+    FragPos = vec3(model * vec4(position, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;
     TexCoords = aTexCoords;
     gl_Position = projection * view * vec4(FragPos,1.0);
+#ifdef MULTI_DRAW
+    DiffuseColor = draw.diffuseColor;
+    SpecularColor = draw.specularColor;
+#else
+    DiffuseColor = diffuseColor;
+    SpecularColor = specularColor;
+#endif
+#ifdef TEXTURE_ARRAYS
+#ifdef MULTI_DRAW
+    TextureLayers = draw.indices.yz;
+#else
+    TextureLayers = textureLayers;
+#endif
+#endif
 }
\ No newline at end of file
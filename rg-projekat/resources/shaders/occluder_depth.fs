@@ -0,0 +1,6 @@
+#version 330 core
+// only the depth is written
+
+void main()
+{
+}
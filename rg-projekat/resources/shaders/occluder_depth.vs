@@ -0,0 +1,14 @@
+#version 330 core
+// depth only pass of the occluders into level 0 of the Hi-Z pyramid (see hiz_occlusion.h)
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 viewProjection;
+uniform mat4 model;
+// packed positions are dequantized as in model_loading.vs
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+
+void main()
+{
+    gl_Position = viewProjection * model * vec4(positionOffset + aPos * positionScale, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 330 core
+flat in float visible;
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(visible, 0.0, 0.0, 1.0);
+}
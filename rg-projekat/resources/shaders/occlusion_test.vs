@@ -0,0 +1,51 @@
+#version 330 core
+// One point per tested box, written to its own texel of the result target: 1 if the box may be
+// visible, 0 if it lies behind the Hi-Z pyramid. Mirrors DepthPyramid::IsVisible.
+layout (location = 0) in vec3 boxMin;
+layout (location = 1) in vec3 boxMax;
+
+uniform mat4 viewProjection;
+uniform sampler2D hiz;
+uniform int levels;
+uniform ivec2 resultSize;
+
+flat out float visible;
+
+float testBox()
+{
+    vec3 minimum = vec3(1e30), maximum = vec3(-1e30);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 p = vec3((corner & 1) != 0 ? boxMax.x : boxMin.x, (corner & 2) != 0 ? boxMax.y : boxMin.y,
+                      (corner & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = viewProjection * vec4(p, 1.0);
+        // reaching through the near plane, in front of everything
+        if (clip.w <= 1e-5 || clip.z < -clip.w)
+            return 1.0;
+        vec3 window = clip.xyz / clip.w * 0.5 + 0.5;
+        minimum = min(minimum, window);
+        maximum = max(maximum, window);
+    }
+    if (maximum.x < 0.0 || maximum.y < 0.0 || minimum.x >= 1.0 || minimum.y >= 1.0)
+        return 0.0;
+
+    ivec2 size = textureSize(hiz, 0);
+    ivec2 first = max(ivec2(floor(minimum.xy * vec2(size))), ivec2(0));
+    ivec2 last = min(ivec2(floor(maximum.xy * vec2(size))), size - 1);
+    int level = 0;
+    while (level + 1 < levels && ((last.x >> level) - (first.x >> level) > 1 || (last.y >> level) - (first.y >> level) > 1))
+        level++;
+    ivec2 lo = first >> level, hi = last >> level;
+    float farthest = 0.0;
+    for (int y = lo.y; y <= hi.y; y++)
+        for (int x = lo.x; x <= hi.x; x++)
+            farthest = max(farthest, texelFetch(hiz, ivec2(x, y), level).r);
+    return minimum.z <= farthest ? 1.0 : 0.0;
+}
+
+void main()
+{
+    visible = testBox();
+    vec2 texel = vec2(gl_VertexID % resultSize.x, gl_VertexID / resultSize.x) + 0.5;
+    gl_Position = vec4(texel / vec2(resultSize) * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+// one color of the overdraw heat map, drawn where the stencil holds its count (see OverdrawView)
+uniform vec3 color;
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(color, 1.0);
+}
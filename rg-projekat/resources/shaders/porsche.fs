@@ -2,11 +2,20 @@
 
 layout (location = 0) out vec4 FragColor;
 
+// with TEXTURE_ARRAYS the textures are layers of arrays, picked by TextureLayers
+#ifdef TEXTURE_ARRAYS
+struct Material{
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
+    float shininess;
+};
+#else
 struct Material{
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
     float shininess;
 };
+#endif
 
 struct DirLight{
     vec3 direction;
@@ -36,15 +45,33 @@ struct SpotLight{
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
-
-uniform vec3 viewPos;
-uniform bool blinn;
+#ifdef INSTANCED
+in vec3 Tint;
+#endif
+
+// frame-global camera and lights, shared by all programs (see frame_uniforms.h)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    bool blinn;
+    DirLight directional;
+    SpotLight spotlight;
+    PointLight pointLights[2];
+};
 
 uniform Material material;
-uniform DirLight directional;
-uniform PointLight pointlight;
-uniform PointLight pointlight2;
-uniform SpotLight spotlight;
+// single color textures arrive as constants (alpha 1) and are not sampled
+flat in vec4 DiffuseColor;
+flat in vec4 SpecularColor;
+#ifdef TEXTURE_ARRAYS
+flat in ivec2 TextureLayers; // diffuse, specular
+vec3 diffuseTexel(){ return DiffuseColor.a > 0.0 ? DiffuseColor.rgb : texture(material.texture_diffuse1, vec3(TexCoords, TextureLayers.x)).rgb; }
+vec3 specularTexel(){ return SpecularColor.a > 0.0 ? SpecularColor.rgb : texture(material.texture_specular1, vec3(TexCoords, TextureLayers.y)).rgb; }
+#else
+vec3 diffuseTexel(){ return DiffuseColor.a > 0.0 ? DiffuseColor.rgb : texture(material.texture_diffuse1, TexCoords).rgb; }
+vec3 specularTexel(){ return SpecularColor.a > 0.0 ? SpecularColor.rgb : texture(material.texture_specular1, TexCoords).rgb; }
+#endif
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
@@ -56,20 +83,23 @@ void main(){
     vec3 viewDir = normalize(viewPos - FragPos);
 
     vec3 result = CalcDirLight(directional, norm, viewDir);
-    result += CalcPointLight(pointlight, norm, FragPos, viewDir);
-    result += CalcPointLight(pointlight2, norm, FragPos, viewDir);
+    result += CalcPointLight(pointLights[0], norm, FragPos, viewDir);
+    result += CalcPointLight(pointLights[1], norm, FragPos, viewDir);
     result += CalcSpotLight(spotlight, norm, FragPos, viewDir);
 
+#ifdef INSTANCED
+    result *= Tint;
+#endif
     FragColor = vec4(result, 1.0);
 }
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir){
     //ambient
-    vec3 ambient = light.ambient * texture(material.texture_diffuse1, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseTexel();
     //diffuse
     vec3 lightDir = normalize(-light.direction);
     float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.texture_diffuse1, TexCoords).rgb;
+    vec3 diffuse = light.diffuse * diff * diffuseTexel();
     //specular
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = 0.0f;
@@ -82,18 +112,18 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir){
         spec = pow(max(dot(viewDir, reflectDir),0.0), material.shininess);
     }
 
-    vec3 specular = light.specular * spec * texture(material.texture_specular1, TexCoords).rgb;
+    vec3 specular = light.specular * spec * specularTexel();
 
     return (ambient + diffuse + specular);
 }
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
     //ambient
-    vec3 ambient = light.ambient * texture(material.texture_diffuse1, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseTexel();
     //diffuse
     vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.texture_diffuse1, TexCoords).rgb;
+    vec3 diffuse = light.diffuse * diff * diffuseTexel();
     //specular
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = 0.0f;
@@ -105,7 +135,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
     }else{
         spec = pow(max(dot(viewDir, reflectDir),0.0), material.shininess);
     }
-    vec3 specular = light.specular * spec * texture(material.texture_specular1, TexCoords).rgb;
+    vec3 specular = light.specular * spec * specularTexel();
 
     //attenuation
     float d = length(light.position - fragPos);
@@ -119,11 +149,11 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
 
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
     //ambient
-    vec3 ambient = light.ambient * texture(material.texture_diffuse1, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseTexel();
     //diffuse
     vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(lightDir, normal),0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.texture_diffuse1, TexCoords).rgb;
+    vec3 diffuse = light.diffuse * diff * diffuseTexel();
     //specular
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = 0.0f;
@@ -136,7 +166,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
         spec = pow(max(dot(viewDir, reflectDir),0.0), material.shininess);
     }
 
-    vec3 specular = light.specular * spec * texture(material.texture_specular1, TexCoords).rgb;
+    vec3 specular = light.specular * spec * specularTexel();
 
 
     //attenuation
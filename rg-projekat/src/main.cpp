@@ -10,19 +10,41 @@
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
-
+#include <learnopengl/asset_loader.h>
+#include <learnopengl/deferred_shading.h>
+#include <learnopengl/frame_uniforms.h>
+#include <learnopengl/multi_draw.h>
+#include <learnopengl/overdraw_view.h>
+#include <learnopengl/scene.h>
+#include <learnopengl/stats_overlay.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <new>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
 unsigned int loadTexture(const char *path);
 unsigned int loadCubemap(vector<std::string> faces);
+void benchmarkModelLoading(const vector<std::string> &paths);
+void benchmarkVertexCache(const vector<std::string> &paths);
+void benchmarkBvh(const std::string &path);
+void benchmarkUniforms();
+bool testLevelsOfDetail(Scene &scene, FrameUniformBuffer &frameUniforms);
+bool testOcclusion(const Scene &scene);
 
 // settings
 const unsigned int SCR_WIDTH = 1100;
 const unsigned int SCR_HEIGHT = 850;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 
 // camera
 Camera camera(glm::vec3(-30.0f, 2.0f, -9.0f));
@@ -31,58 +53,161 @@ float lastY = (float)SCR_HEIGHT / 2.0;
 bool firstMouse = true;
 
 bool blinn = true;
+bool depthPrepass = false;
+StatsOverlay overlay;
+OverdrawView overdrawView;
+DeferredShading deferredShading;
 
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-struct PointLight {
-    glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
+FrameUniforms buildFrameUniforms(const glm::mat4 &projection, const glm::mat4 &view, const Scene &scene);
+void buildLightVolumes(const Scene &scene, vector<LightVolume> &volumes);
+
+// models the headless benchmarks run on
+const vector<std::string> BENCH_MODELS = {
+    "resources/objects/cube/cube.obj",
+    "resources/objects/village/VolgarStreet.obj",
+    "resources/objects/nissan/source/SA5HLA5LO5H1RQJ42KKT685IS.obj",
+    "resources/objects/mercedes/9IGEYFTP0J6AQ1IDGYCN823X7.obj",
+    "resources/objects/porsche/N17ARA9C0GT5W7X12AGMQ0F88.obj",
+    "resources/objects/lamppost/Wooden Lantern.obj"
 };
-PointLight initPointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
-                         float constant, float linear, float quadratic);
-void setPointLight(std::string name, PointLight pointLight, Shader shader);
 
-struct DirLight {
-    glm::vec3 direction;
+#ifdef COUNT_HEAP_ALLOCATIONS
+// every operator new goes through here so --bench-uniforms can count heap allocations. Only the
+// project_base_bench target defines COUNT_HEAP_ALLOCATIONS, the game keeps the default allocator.
+const bool HEAP_ALLOCATIONS_COUNTED = true;
+static std::atomic<unsigned long> heapAllocations(0);
 
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-};
+void *operator new(std::size_t size)
+{
+    heapAllocations++;
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
 
-struct SpotLight {
-    glm::vec3 position;
-    glm::vec3 direction;
-    float cutOff;
-    float outerCutOff;
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
 
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#else
+const bool HEAP_ALLOCATIONS_COUNTED = false;
+static const unsigned long heapAllocations = 0;
+#endif
 
-};
+int main(int argc, char **argv) {
+    // headless benchmarks, no window or GL context needed
+    if (argc > 1 && strcmp(argv[1], "--bench-load") == 0) {
+        benchmarkModelLoading(BENCH_MODELS);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-vertex-cache") == 0) {
+        benchmarkVertexCache(BENCH_MODELS);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-bvh") == 0) {
+        benchmarkBvh(BENCH_MODELS[1]);
+        return 0;
+    }
+    bool benchUniforms = false;
+    bool printStats = false;
+    bool frustumCulling = true;
+    bool bvhCulling = true;
+    bool multiDraw = false;
+    bool instancing = true;
+    bool textureArrays = false;
+    bool lod = true;
+    bool testLod = false;
+    bool testOcclusionCulling = false;
+    bool deferred = false;
+    OcclusionMode occlusion = OCCLUSION_GPU;
+    std::string scenePath = "resources/scenes/village.scene";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-uniforms") == 0)
+            benchUniforms = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            printStats = true;
+        else if (strcmp(argv[i], "--no-cull") == 0)
+            frustumCulling = false;
+        else if (strcmp(argv[i], "--no-bvh") == 0)
+            bvhCulling = false;
+        else if (strcmp(argv[i], "--multi-draw") == 0)
+            multiDraw = true;
+        else if (strcmp(argv[i], "--no-instancing") == 0)
+            instancing = false;
+        else if (strcmp(argv[i], "--texture-arrays") == 0)
+            textureArrays = true;
+        else if (strcmp(argv[i], "--no-lod") == 0)
+            lod = false;
+        else if (strcmp(argv[i], "--test-lod") == 0)
+            testLod = true;
+        else if (strcmp(argv[i], "--depth-prepass") == 0)
+            depthPrepass = true;
+        else if (strcmp(argv[i], "--overdraw") == 0)
+            overdrawView.visible = true;
+        else if (strcmp(argv[i], "--deferred") == 0)
+            deferred = true;
+        else if (strcmp(argv[i], "--test-occlusion") == 0)
+            testOcclusionCulling = true;
+        else if (strcmp(argv[i], "--occlusion") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "gpu") == 0)
+                occlusion = OCCLUSION_GPU;
+            else if (strcmp(argv[i], "cpu") == 0)
+                occlusion = OCCLUSION_CPU;
+            else if (strcmp(argv[i], "off") == 0)
+                occlusion = OCCLUSION_OFF;
+            else
+                std::cout << "ERROR::ARGUMENTS:: --occlusion takes gpu, cpu or off, not " << argv[i] << std::endl;
+        }
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            scenePath = argv[++i];
+    }
+    Scene scene;
+    if (!benchUniforms && !scene.Load(scenePath))
+        return -1;
+    scene.frustumCulling = frustumCulling;
+    scene.bvhCulling = bvhCulling;
+    scene.instancing = instancing;
+    scene.textureArrays = textureArrays;
+    scene.lod = lod;
+    scene.occlusion = occlusion;
+    // headless as well, the software rasterizer needs no GL
+    if (testOcclusionCulling)
+        return testOcclusion(scene) ? 0 : 1;
 
-int main() {
     // glfw: initialize and configure
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_STENCIL_BITS, 8); // the overdraw view counts fragments in it
+    if (benchUniforms || testLod)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Village", nullptr, nullptr);
+    // glfw window creation: 3.3 and one draw call per mesh, or with --multi-draw 4.3 for
+    // multi-draw indirect where the driver has it, falling back to 3.3
+    GLFWwindow* window = nullptr;
+    if (multiDraw && !benchUniforms && !testLod) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Village", nullptr, nullptr);
+    }
+    if (window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Village", nullptr, nullptr);
+    }
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -92,6 +217,7 @@ int main() {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -102,15 +228,26 @@ int main() {
         return -1;
     }
 
+    // GL benchmarks, run in a hidden window
+    if (benchUniforms) {
+        benchmarkUniforms();
+        glfwTerminate();
+        return 0;
+    }
+
+    TextureRegistry::Instance().DetectCompressionSupport();
+
     // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
+    GLState &state = GLState::Get();
+    state.Enable(GL_DEPTH_TEST);
+    state.DepthFunc(GL_LESS);
 
     // face culling
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    state.Enable(GL_CULL_FACE);
+    state.CullFace(GL_BACK);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.Enable(GL_BLEND);
+    state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // build and compile shaders
     Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
@@ -162,8 +299,8 @@ int main() {
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+    state.BindVertexArray(skyboxVAO);
+    state.BindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -180,277 +317,102 @@ int main() {
     // shader configuration
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
+    GLint skyboxView = skyboxShader.uniform("view");
+    GLint skyboxProjection = skyboxShader.uniform("projection");
 
-    // ################################################# MODELS #################################################
-    Model cube("resources/objects/cube/cube.obj");
-    cube.SetShaderTextureNamePrefix("material.");
-    Shader cubeShader("resources/shaders/model_loading.vs", "resources/shaders/model_loading.fs");
-    // load models
-    Model village("resources/objects/village/VolgarStreet.obj");
-    village.SetShaderTextureNamePrefix("material.");
-    Shader villageShader("resources/shaders/model_loading.vs", "resources/shaders/model_loading.fs");
-
-    Model nissan("resources/objects/nissan/source/SA5HLA5LO5H1RQJ42KKT685IS.obj");
-    nissan.SetShaderTextureNamePrefix("material.");
-    Shader nissanShader("resources/shaders/model_loading.vs", "resources/shaders/nissan.fs");
-
-    Model mercedes("resources/objects/mercedes/9IGEYFTP0J6AQ1IDGYCN823X7.obj");
-    mercedes.SetShaderTextureNamePrefix("material.");
-    Shader mercedesShader("resources/shaders/model_loading.vs", "resources/shaders/mercedes.fs");
-
-    Model porsche("resources/objects/porsche/N17ARA9C0GT5W7X12AGMQ0F88.obj");
-    porsche.SetShaderTextureNamePrefix("material.");
-    Shader porscheShader("resources/shaders/model_loading.vs", "resources/shaders/porsche.fs");
-
-    Model lamppost("resources/objects/lamppost/Wooden Lantern.obj");
-    lamppost.SetShaderTextureNamePrefix("material.");
-    Shader lamppostShader("resources/shaders/model_loading.vs", "resources/shaders/lamppost.fs");
-
-
-    // lighting info
-    // ---------------------------
-    // directional light
-    DirLight directional;
-    glm::vec3 vec1 = glm::vec3(115.0f, 80.0f, -20.0f);
-    glm::vec3 vec2 = glm::vec3(105.0f, 75.0f, -18.0f);
-    directional.direction = vec2 - vec1;
-    directional.ambient = glm::vec3(0.12f);
-    directional.diffuse = glm::vec3(0.5f);
-    directional.specular = glm::vec3(0.6f);
-
-    // spotlight
-    SpotLight spotlight;
-    spotlight.position = camera.Position;
-    spotlight.direction = camera.Front;
-    spotlight.ambient = glm::vec3(0.2f);
-    spotlight.diffuse = glm::vec3(1.0f, 0.894f, 0.627f);
-    spotlight.specular = glm::vec3(1.0f, 0.894f, 0.627f);
-    spotlight.cutOff = glm::cos(glm::radians(13.0f));
-    spotlight.outerCutOff = glm::cos(glm::radians(16.5f));
-
-    // pointlight
-    PointLight pointLight = initPointLight(glm::vec3(-15.0f, -0.6f, 3.83f),
-                                                 glm::vec3(5.5f, 3.7f, 1.0f),
-                                           glm::vec3(5.5f, 3.7f, 1.0f),
-                                           glm::vec3(5.5f, 3.7f, 1.0f),
-                                                1.0f, 0.09f, 0.032f);
-    PointLight pointLight2 = initPointLight(glm::vec3(-1.0f, -0.6f, -4.13f),
-                                           glm::vec3(5.5f, 3.7f, 1.0f),
-                                           glm::vec3(5.5f, 3.7f, 1.0f),
-                                           glm::vec3(5.5f, 3.7f, 1.0f),
-                                           1.0f, 0.09f, 0.032f);
+    // the level of detail test draws models directly, with the per mesh shader variants
+    scene.multiDraw = multiDraw && !testLod && MultiDraw::Load((GLADloadproc)glfwGetProcAddress);
+    scene.deferred = deferred && !testLod;
+    std::cout << "RENDERER:: OpenGL " << glGetString(GL_VERSION) << ", "
+              << (scene.multiDraw ? "multi-draw indirect" : "one draw call per mesh") << ", "
+              << (scene.deferred ? "deferred" : "forward") << " shading" << std::endl;
 
+    // the shaders come first, so models only upload the vertex attributes they read
+    FrameUniformBuffer frameUniforms;
+    frameUniforms.Create();
+    scene.CreateShaders();
+
+    // ################################################# MODELS #################################################
+    // load the scene's models, importing meshes and decoding textures in parallel
+    {
+        AssetLoader loader;
+        scene.LoadModels(loader);
+        loader.Finish();
+    }
+    TextureRegistry::Instance().PrintStats();
+    scene.PrintGeometryStats();
+    if (testLod) {
+        bool passed = testLevelsOfDetail(scene, frameUniforms);
+        scene.ReleaseTextures();
+        scene.ReleaseBuffers();
+        frameUniforms.Destroy();
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+    overlay.Init(window);
+    overdrawView.Create();
+    if (scene.deferred)
+        deferredShading.Create();
 
     // render loop
+    float lastStatsPrint = 0.0f;
+    vector<LightVolume> lightVolumes;
     while (!glfwWindowShouldClose(window)) {
         // per-frame time logic
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        FrameStats::Get().Reset();
 
         // input
         processInput(window);
 
         // render
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
         // view/projection transformations
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 model = glm::mat4(1.0f);
-
-        villageShader.use();
-        model = glm::mat4(1.0f);
-        villageShader.setMat4("projection", projection);
-        villageShader.setMat4("view", view);
-//        villageShader.setMat4("model", model);
-        villageShader.setVec3("viewPos", camera.Position);
-        villageShader.setFloat("material.shininess", 16.0f);
-        //Directional light
-        villageShader.setVec3("directional.direction", directional.direction);
-        villageShader.setVec3("directional.ambient", directional.ambient);
-        villageShader.setVec3("directional.diffuse", directional.diffuse);
-        villageShader.setVec3("directional.specular", directional.specular);
-        //Spotlight
-        villageShader.setVec3("spotlight.position", camera.Position);
-        villageShader.setVec3("spotlight.direction", camera.Front);
-        villageShader.setVec3("spotlight.ambient", spotlight.ambient);
-        villageShader.setVec3("spotlight.diffuse", spotlight.diffuse);
-        villageShader.setFloat("spotlight.cutOff", spotlight.cutOff);
-        villageShader.setFloat("spotlight.outerCutOff", spotlight.outerCutOff);
-        // Pointlight
-        setPointLight("pointlight.", pointLight, villageShader);
-        setPointLight("pointlight2.", pointLight2, villageShader);
-        // blinn
-        villageShader.setBool("blinn", blinn);
-        // render the loaded model
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -4.0f, 0.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(1.0f));	// it's a bit too big for our scene, so scale it down
-        villageShader.setMat4("model", model);
-        village.Draw(villageShader);
-
-
-        // ################################################# LAMPPOST1 #################################################
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-15.0f, -0.6f, 3.83f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(0.1f));	// it's a bit too big for our scene, so scale it down
-        cubeShader.setMat4("model", model);
-        cube.Draw(cubeShader);
-
-        lamppostShader.use();
-        model = glm::mat4(1.0f);
-        lamppostShader.setMat4("projection", projection);
-        lamppostShader.setMat4("view", view);
-//        villageShader.setMat4("model", model);
-        lamppostShader.setVec3("viewPos", camera.Position);
-        lamppostShader.setFloat("material.shininess", 16.0f);
-        //Directional light
-        lamppostShader.setVec3("directional.direction", directional.direction);
-        lamppostShader.setVec3("directional.ambient", directional.ambient);
-        lamppostShader.setVec3("directional.diffuse", directional.diffuse);
-        lamppostShader.setVec3("directional.specular", directional.specular);
-        //Spotlight
-        lamppostShader.setVec3("spotlight.position", camera.Position);
-        lamppostShader.setVec3("spotlight.direction", camera.Front);
-        lamppostShader.setVec3("spotlight.ambient", spotlight.ambient);
-        lamppostShader.setVec3("spotlight.diffuse", spotlight.diffuse);
-        lamppostShader.setFloat("spotlight.cutOff", spotlight.cutOff);
-        lamppostShader.setFloat("spotlight.outerCutOff", spotlight.outerCutOff);
-        // Pointlight
-        setPointLight("pointlight.", pointLight, lamppostShader);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-15.0f, -4.0f, 6.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(0.47f));	// it's a bit too big for our scene, so scale it down
-        lamppostShader.setMat4("model", model);
-        lamppost.Draw(lamppostShader);
-
-
-        // ################################################# LAMPPOST2 #################################################
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.0f, -0.6f, -4.13f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(0.1f));	// it's a bit too big for our scene, so scale it down
-        cubeShader.setMat4("model", model);
-        cube.Draw(cubeShader);
-
-        setPointLight("pointlight.", pointLight2, lamppostShader);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.0f, -4.0f, -6.3f)); // translate it down so it's at the center of the scene
-        model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.47f));	// it's a bit too big for our scene, so scale it down
-        lamppostShader.setMat4("model", model);
-        lamppost.Draw(lamppostShader);
-
-
-
-        nissanShader.use();
-        model = glm::mat4(1.0f);
-        nissanShader.setMat4("projection", projection);
-        nissanShader.setMat4("view", view);
-//        nissanShader.setMat4("model", model);
-        nissanShader.setVec3("viewPos", camera.Position);
-        nissanShader.setFloat("material.shininess", 16.0f);
-        //Directional light
-        nissanShader.setVec3("directional.direction", directional.direction);
-        nissanShader.setVec3("directional.ambient", directional.ambient);
-        nissanShader.setVec3("directional.diffuse", directional.diffuse);
-        nissanShader.setVec3("directional.specular", directional.specular);
-        //Spotlight
-        nissanShader.setVec3("spotlight.position", camera.Position);
-        nissanShader.setVec3("spotlight.direction", camera.Front);
-        nissanShader.setVec3("spotlight.ambient", spotlight.ambient);
-        nissanShader.setVec3("spotlight.diffuse", spotlight.diffuse);
-        nissanShader.setFloat("spotlight.cutOff", spotlight.cutOff);
-        nissanShader.setFloat("spotlight.outerCutOff", spotlight.outerCutOff);
-        // blinn
-        nissanShader.setBool("blinn", blinn);
-        // Pointlight
-        setPointLight("pointlight.", pointLight, nissanShader);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-20.0f, -2.75f, 1.9f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(3.0f));	// it's a bit too big for our scene, so scale it down
-        nissanShader.setMat4("model", model);
-        nissan.Draw(nissanShader);
-
-
-
-        mercedesShader.use();
-        model = glm::mat4(1.0f);
-        mercedesShader.setMat4("projection", projection);
-        mercedesShader.setMat4("view", view);
-//        mercedesShader.setMat4("model", model);
-        mercedesShader.setVec3("viewPos", camera.Position);
-        mercedesShader.setFloat("material.shininess", 16.0f);
-        //Directional light
-        mercedesShader.setVec3("directional.direction", directional.direction);
-        mercedesShader.setVec3("directional.ambient", directional.ambient);
-        mercedesShader.setVec3("directional.diffuse", directional.diffuse);
-        mercedesShader.setVec3("directional.specular", directional.specular);
-        //Spotlight
-        mercedesShader.setVec3("spotlight.position", camera.Position);
-        mercedesShader.setVec3("spotlight.direction", camera.Front);
-        mercedesShader.setVec3("spotlight.ambient", spotlight.ambient);
-        mercedesShader.setVec3("spotlight.diffuse", spotlight.diffuse);
-        mercedesShader.setFloat("spotlight.cutOff", spotlight.cutOff);
-        mercedesShader.setFloat("spotlight.outerCutOff", spotlight.outerCutOff);
-        // blinn
-        mercedesShader.setBool("blinn", blinn);
-        // Pointlight
-        setPointLight("pointlight.", pointLight2, mercedesShader);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(7.0f, -2.69f, -2.5f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(3.0f));	// it's a bit too big for our scene, so scale it down
-        model = glm::rotate(model, (float)glm::radians(180.0), glm::vec3(0.0f, 1.0f, 0.0f));
-        mercedesShader.setMat4("model", model);
-        mercedes.Draw(mercedesShader);
-
-
-        porscheShader.use();
-        model = glm::mat4(1.0f);
-        porscheShader.setMat4("projection", projection);
-        porscheShader.setMat4("view", view);
-//        porscheShader.setMat4("model", model);
-        porscheShader.setVec3("viewPos", camera.Position);
-        porscheShader.setFloat("material.shininess", 16.0f);
-        //Directional light
-        porscheShader.setVec3("directional.direction", directional.direction);
-        porscheShader.setVec3("directional.ambient", directional.ambient);
-        porscheShader.setVec3("directional.diffuse", directional.diffuse);
-        porscheShader.setVec3("directional.specular", directional.specular);
-        //Spotlight
-        porscheShader.setVec3("spotlight.position", camera.Position);
-        porscheShader.setVec3("spotlight.direction", camera.Front);
-        porscheShader.setVec3("spotlight.ambient", spotlight.ambient);
-        porscheShader.setVec3("spotlight.diffuse", spotlight.diffuse);
-        porscheShader.setFloat("spotlight.cutOff", spotlight.cutOff);
-        porscheShader.setFloat("spotlight.outerCutOff", spotlight.outerCutOff);
-        // blinn
-        porscheShader.setBool("blinn", blinn);
-        // Pointlight
-        setPointLight("pointlight.", pointLight, porscheShader);
-        setPointLight("pointlight2.", pointLight2, porscheShader);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-7.0f, -2.69f, -2.5f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(3.0f));	// it's a bit too big for our scene, so scale it down
-        porscheShader.setMat4("model", model);
-        porsche.Draw(porscheShader);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+        // camera and lights go up once for all programs
+        frameUniforms.Update(buildFrameUniforms(projection, view, scene));
+        scene.depthPrepass = depthPrepass;
+        scene.countOverdraw = overdrawView.visible;
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        if (scene.deferred)
+            deferredShading.Begin(framebufferWidth, framebufferHeight);
+        scene.targetFramebuffer = scene.deferred ? deferredShading.Framebuffer() : 0;
+        scene.targetViewport = glm::ivec4(0, 0, framebufferWidth, framebufferHeight);
+        scene.Draw(view, projection, FAR_PLANE, (float)SCR_HEIGHT);
+        if (scene.deferred) {
+            buildLightVolumes(scene, lightVolumes);
+            deferredShading.Light(lightVolumes, projection * view);
+        }
 
         // draw skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+        state.DepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
         skyboxShader.use();
         view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
+        skyboxShader.setMat4(skyboxView, view);
+        skyboxShader.setMat4(skyboxProjection, projection);
 
         // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        state.BindVertexArray(skyboxVAO);
+        state.BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
+        FrameStats::Get().drawCalls++;
+        state.DepthFunc(GL_LESS); // set depth function back to default
 
+        if (overdrawView.visible)
+            overdrawView.Show(framebufferWidth, framebufferHeight);
+        overlay.Draw(FrameStats::Get(), deltaTime);
+
+        if (printStats && currentFrame - lastStatsPrint >= 1.0f) {
+            FrameStats::Get().Print();
+            lastStatsPrint = currentFrame;
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(window);
@@ -458,8 +420,14 @@ int main() {
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
-    glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &skyboxVAO);
+    overlay.Shutdown();
+    overdrawView.Destroy();
+    deferredShading.Destroy();
+    scene.ReleaseTextures();
+    scene.ReleaseBuffers();
+    frameUniforms.Destroy();
+    state.DeleteVertexArray(skyboxVAO);
+    state.DeleteBuffer(skyboxVBO);
 
     glfwTerminate();
     return 0;
@@ -485,6 +453,17 @@ void processInput(GLFWwindow *window)
         blinn = true;
 }
 
+// glfw: F1 shows/hides the stats overlay
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+        overlay.visible = !overlay.visible;
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+        overdrawView.visible = !overdrawView.visible;
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
+        depthPrepass = !depthPrepass;
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
@@ -536,7 +515,7 @@ unsigned int loadTexture(char const * path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -568,7 +547,7 @@ unsigned int loadCubemap(vector<std::string> faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
@@ -594,27 +573,635 @@ unsigned int loadCubemap(vector<std::string> faces)
     return textureID;
 }
 
-PointLight initPointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
-                         float constant, float linear, float quadratic) {
-    PointLight pointLight;
-    pointLight.position = position;
-    pointLight.ambient = ambient;
-    pointLight.diffuse = diffuse;
-    pointLight.specular = specular;
-    pointLight.constant = constant;
-    pointLight.linear = linear;
-    pointLight.quadratic = quadratic;
-    return pointLight;
+// compares importing every model through ASSIMP (cold) with reading it back from the binary mesh cache (warm)
+void benchmarkModelLoading(const vector<std::string> &paths)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+
+    std::cout << "model | meshes | cold (assimp) ms | warm (cache) ms | speedup" << std::endl;
+    double coldTotal = 0.0, warmTotal = 0.0;
+    for (const std::string &path : paths) {
+        ModelData cold, warm;
+        Clock::time_point start = Clock::now();
+        bool imported = Model::LoadModelData(path, cold, false);
+        Clock::time_point importedAt = Clock::now();
+        if (!imported || !MeshCache::write(path, cold)) {
+            std::cout << path << " | failed to import or write cache" << std::endl;
+            continue;
+        }
+        Clock::time_point writtenAt = Clock::now();
+        bool cached = MeshCache::read(path, warm);
+        Clock::time_point readAt = Clock::now();
+        if (!cached) {
+            std::cout << path << " | failed to read cache" << std::endl;
+            continue;
+        }
+
+        double coldMs = ms(start, importedAt);
+        double warmMs = ms(writtenAt, readAt);
+        coldTotal += coldMs;
+        warmTotal += warmMs;
+        std::cout << path << " | " << warm.meshes.size() << " | " << coldMs << " | " << warmMs
+                  << " | " << coldMs / std::max(warmMs, 0.001) << "x" << std::endl;
+    }
+    std::cout << "total | | " << coldTotal << " | " << warmTotal << " | "
+              << coldTotal / std::max(warmTotal, 0.001) << "x" << std::endl;
 }
 
-void setPointLight(std::string name, PointLight pointLight, Shader shader) {
-    shader.setVec3(name + "position", pointLight.position);
-    shader.setVec3(name + "ambient", pointLight.ambient * 0.3f);
-    shader.setVec3(name + "diffuse", pointLight.diffuse * 2.0f);
-    shader.setVec3(name + "specular", pointLight.specular * 0.5f);
-    shader.setFloat(name + "constant", pointLight.constant);
-    shader.setFloat(name + "linear", pointLight.linear);
-    shader.setFloat(name + "quadratic", pointLight.quadratic);
-    shader.setVec3("viewPos", camera.Position);
-    shader.setFloat("material.shininess", 32.0f);
+// Imports every model without MeshOptimizer, then simulates the post-transform vertex cache (FIFO,
+// 16 and 32 entries) over the index buffers in file order and after optimizing them
+void benchmarkVertexCache(const vector<std::string> &paths)
+{
+    typedef std::chrono::steady_clock Clock;
+    struct Totals {
+        size_t triangles = 0, vertices = 0, misses16 = 0, misses32 = 0;
+        void add(const ModelData &data) {
+            for (const MeshData &mesh : data.meshes) {
+                triangles += mesh.indices.size() / 3;
+                vertices += mesh.vertices.size();
+                misses16 += MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.vertices.size(), 16).misses;
+                misses32 += MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.vertices.size(), 32).misses;
+            }
+        }
+        void print() const {
+            std::cout << (double)misses16 / std::max<size_t>(triangles, 1) << " / " << (double)misses32 / std::max<size_t>(triangles, 1)
+                      << " | " << (double)misses16 / std::max<size_t>(vertices, 1) << " / " << (double)misses32 / std::max<size_t>(vertices, 1);
+        }
+    };
+
+    std::cout << "model | triangles | file order ACMR 16/32 | ATVR 16/32 | optimized ACMR 16/32 | ATVR 16/32 | optimize ms" << std::endl;
+    for (const std::string &path : paths) {
+        ModelData data;
+        if (!Model::LoadModelData(path, data, false, false)) {
+            std::cout << path << " | failed to import" << std::endl;
+            continue;
+        }
+        Totals before, after;
+        before.add(data);
+        Clock::time_point start = Clock::now();
+        for (MeshData &mesh : data.meshes)
+            MeshOptimizer::Optimize(mesh);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        after.add(data);
+
+        std::cout << path << " | " << before.triangles << " | ";
+        before.print();
+        std::cout << " | ";
+        after.print();
+        std::cout << " | " << ms << std::endl;
+    }
+}
+
+// Splits the village into clusters of several sizes and compares, over the same random views from
+// the street, culling them one by one (BoundsArray) with traversing a Bvh over them, and how much
+// geometry stays visible; plus the cost of a ray query against the cluster boxes
+void benchmarkBvh(const std::string &path)
+{
+    typedef std::chrono::steady_clock Clock;
+    const int views = 2000;
+    const unsigned int clusterSizes[] = {0, 8192, 4096, 2048, 1024, 512, 256, 128};
+
+    ModelData source;
+    if (!Model::LoadModelData(path, source, false, false)) {
+        std::cout << path << " | failed to import" << std::endl;
+        return;
+    }
+    MeshBounds modelBounds = MeshBounds::FromVertices(source.meshes[0].vertices);
+    for (const MeshData &mesh : source.meshes) {
+        MeshBounds bounds = MeshBounds::FromVertices(mesh.vertices);
+        modelBounds.min = glm::min(modelBounds.min, bounds.min);
+        modelBounds.max = glm::max(modelBounds.max, bounds.max);
+    }
+
+    // views at the height of the starting camera (the village entity sits 4 units lower), looking
+    // anywhere around, and rays from them slightly downwards
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    vector<Frustum> frustums;
+    vector<glm::vec3> origins, directions;
+    for (int i = 0; i < views; i++) {
+        glm::vec3 position(modelBounds.min.x + (modelBounds.max.x - modelBounds.min.x) * unit(random), camera.Position.y + 4.0f,
+                           modelBounds.min.z + (modelBounds.max.z - modelBounds.min.z) * unit(random));
+        float yaw = glm::radians(360.0f * unit(random));
+        glm::vec3 front(std::cos(yaw), -0.2f, std::sin(yaw));
+        frustums.push_back(Frustum(projection * glm::lookAt(position, position + front, glm::vec3(0.0f, 1.0f, 0.0f))));
+        origins.push_back(position);
+        directions.push_back(glm::normalize(front));
+    }
+
+    std::cout << "cluster size | clusters | build ms | bvh nodes / depth | linear cull us | bvh cull us | nodes visited"
+              << " | visible clusters | visible triangles % | ray query us" << std::endl;
+    for (unsigned int clusterSize : clusterSizes) {
+        ModelData data = source;
+        MeshClusterer::Split(data, clusterSize);
+        vector<MeshBounds> boxes;
+        vector<size_t> triangles;
+        size_t totalTriangles = 0;
+        BoundsArray linear;
+        for (const MeshData &mesh : data.meshes) {
+            boxes.push_back(MeshBounds::FromVertices(mesh.vertices));
+            linear.Add(boxes.back());
+            triangles.push_back(mesh.indices.size() / 3);
+            totalTriangles += triangles.back();
+        }
+
+        Clock::time_point start = Clock::now();
+        Bvh bvh;
+        bvh.Build(boxes, Scene::BVH_LEAF_SIZE);
+        double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        vector<unsigned char> visible;
+        size_t linearVisible = 0;
+        start = Clock::now();
+        for (const Frustum &frustum : frustums)
+            linearVisible += linear.Cull(frustum, visible);
+        double linearUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / views;
+
+        size_t bvhVisible = 0, nodesVisited = 0, visibleTriangles = 0;
+        start = Clock::now();
+        for (const Frustum &frustum : frustums)
+            bvhVisible += bvh.Cull(frustum, visible, &nodesVisited);
+        double bvhUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / views;
+        for (const Frustum &frustum : frustums) {
+            bvh.Cull(frustum, visible);
+            for (size_t i = 0; i < visible.size(); i++)
+                visibleTriangles += visible[i] ? triangles[i] : 0;
+        }
+
+        int hits = 0;
+        start = Clock::now();
+        for (int i = 0; i < views; i++) {
+            float distance = FAR_PLANE;
+            hits += bvh.Raycast(origins[i], directions[i], distance, [](unsigned int, float entry) { return entry; }) >= 0;
+        }
+        double rayUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / views;
+
+        std::cout << clusterSize << " | " << data.meshes.size() << " | " << buildMs << " | " << bvh.nodes.size() << " / "
+                  << bvh.Depth() << " | " << linearUs << " | " << bvhUs << " | " << (double)nodesVisited / views << " | "
+                  << (double)bvhVisible / views << " (linear " << (double)linearVisible / views << ") | "
+                  << 100.0 * visibleTriangles / ((double)totalTriangles * views) << " | " << rayUs << " (" << hits
+                  << " hits)" << std::endl;
+    }
+}
+
+// one glUniform* call of the render loop. prefix is set for the point light members, whose names
+// the render loop used to concatenate every frame
+struct BenchUniform {
+    int shader;
+    const char *prefix;
+    const char *name;
+    int components; // 0 int, 1 float, 3 vec3, 16 mat4
+    GLint location;
+    unsigned int paths; // bit per benchmarked path that uploads it
+};
+
+// Replays the uniform updates of one frame of the render loop four ways: glGetUniformLocation per
+// setter, the cached table looked up by name, resolved handles, and the FrameData uniform buffer with
+// only the per-object uniforms left. The first three replay the per-uniform frame from before the
+// buffer; those names are block members now, so the driver drops their uploads early (location -1)
+// and those rows understate what they used to cost.
+void benchmarkUniforms()
+{
+    typedef std::chrono::steady_clock Clock;
+    const int frames = 2000;
+    const char *fragmentShaders[] = {"model_loading.fs", "lamppost.fs", "nissan.fs", "mercedes.fs", "porsche.fs"};
+    const int modelCount[] = {3, 2, 1, 1, 1};      // the village shader also uploads the two cube transforms
+
+    vector<Shader> shaders;
+    for (const char *fragment : fragmentShaders)
+        shaders.emplace_back("resources/shaders/model_loading.vs", (std::string("resources/shaders/") + fragment).c_str());
+
+    struct { const char *name; int components; } frameUniforms[] = {
+        {"projection", 16}, {"view", 16}, {"viewPos", 3}, {"material.shininess", 1},
+        {"directional.direction", 3}, {"directional.ambient", 3}, {"directional.diffuse", 3}, {"directional.specular", 3},
+        {"spotlight.position", 3}, {"spotlight.direction", 3}, {"spotlight.ambient", 3}, {"spotlight.diffuse", 3},
+        {"spotlight.cutOff", 1}, {"spotlight.outerCutOff", 1}, {"blinn", 1}
+    }, pointLightUniforms[] = {
+        {"position", 3}, {"ambient", 3}, {"diffuse", 3}, {"specular", 3}, {"constant", 1}, {"linear", 1}, {"quadratic", 1},
+    };
+    // point lights set per shader, in render loop order; lamppost sets "pointlight." once per lamp
+    const vector<vector<const char *>> pointLights = {
+        {"pointlight.", "pointlight2."}, {"pointlight.", "pointlight."}, {"pointlight."}, {"pointlight."},
+        {"pointlight.", "pointlight2."}
+    };
+
+    vector<BenchUniform> writes;
+    for (int i = 0; i < (int)shaders.size(); i++) {
+        auto add = [&](const char *prefix, const char *name, int components, unsigned int paths = 0x7) {
+            writes.push_back(BenchUniform{i, prefix, name, components, shaders[i].uniform(std::string(prefix) + name), paths});
+        };
+        for (const auto &uniform : frameUniforms)
+            add("", uniform.name, uniform.components);
+        for (const char *prefix : pointLights[i]) {
+            if (i == 1)
+                add("", "pointLightIndex", 0, 0x8);
+            for (const auto &uniform : pointLightUniforms)
+                add(prefix, uniform.name, uniform.components);
+            add("", "viewPos", 3);
+            add("", "material.shininess", 1);
+        }
+        for (int model = 0; model < modelCount[i]; model++)
+            add("", "model", 16, 0xf);
+    }
+
+    FrameUniformBuffer buffer;
+    buffer.Create();
+    for (const Shader &shader : shaders)
+        FrameUniformBuffer::Bind(shader);
+    FrameUniforms frameData = FrameUniforms();
+
+    glm::mat4 matrix(1.0f);
+    auto upload = [&](GLint location, int components) {
+        if (components == 16)
+            glUniformMatrix4fv(location, 1, GL_FALSE, &matrix[0][0]);
+        else if (components == 3)
+            glUniform3fv(location, 1, &matrix[0][0]);
+        else if (components == 1)
+            glUniform1f(location, matrix[0][0]);
+        else
+            glUniform1i(location, 0);
+    };
+
+    std::cout << "uniform path | ms/frame | driver calls/frame | strings built/frame | heap allocations/frame" << std::endl;
+    for (int path = 0; path < 4; path++) {
+        unsigned long driverCalls = 0, strings = 0;
+        unsigned long allocationsBefore = heapAllocations;
+        Clock::time_point start = Clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            if (path == 3) {
+                buffer.Update(frameData);
+                driverCalls += 3;
+            }
+            int bound = -1;
+            for (const BenchUniform &write : writes) {
+                if (!(write.paths & (1u << path)))
+                    continue;
+                const Shader &shader = shaders[write.shader];
+                if (write.shader != bound) {
+                    shader.use();
+                    bound = write.shader;
+                    driverCalls++;
+                }
+                if (path == 0) {
+                    // what the setters did before: a std::string per call, concatenated for point lights
+                    std::string name = *write.prefix ? std::string(write.prefix) + write.name : std::string(write.name);
+                    strings += *write.prefix ? 2 : 1;
+                    upload(glGetUniformLocation(shader.ID, name.c_str()), write.components);
+                    driverCalls += 2;
+                } else {
+                    GLint location = path == 1 ? shader.uniform(*write.prefix ? std::string(write.prefix) + write.name : std::string(write.name))
+                                               : write.location;
+                    strings += path == 1 ? (*write.prefix ? 2 : 1) : 0;
+                    upload(location, write.components);
+                    driverCalls++;
+                }
+            }
+        }
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        unsigned long allocations = heapAllocations - allocationsBefore;
+
+        const char *names[] = {"glGetUniformLocation", "cached, by name", "handles", "uniform buffer"};
+        std::cout << names[path] << " | " << ms / frames << " | " << (double)driverCalls / frames << " | "
+                  << (double)strings / frames << " | ";
+        if (HEAP_ALLOCATIONS_COUNTED)
+            std::cout << (double)allocations / frames << std::endl;
+        else
+            std::cout << "n/a" << std::endl;
+    }
+    if (!HEAP_ALLOCATIONS_COUNTED)
+        std::cout << "heap allocations are only counted by the project_base_bench build" << std::endl;
+    buffer.Destroy();
+}
+
+// Renders the first entity of every model with levels of detail at the distance where each level
+// starts being selected, once at that level and once at full detail, into an offscreen target,
+// and compares the two images. A level fails when more than LOD_TEST_MAX_DIFFERENT of the pixels
+// either image covers differ by more than LOD_TEST_TOLERANCE in some channel.
+bool testLevelsOfDetail(Scene &scene, FrameUniformBuffer &frameUniforms)
+{
+    const int size = 512;
+    const int LOD_TEST_TOLERANCE = 32;
+    const float LOD_TEST_MAX_DIFFERENT = 0.05f;
+
+    unsigned int framebuffer, color, depth;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::LOD_TEST:: framebuffer not complete" << std::endl;
+        return false;
+    }
+    glViewport(0, 0, size, size);
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, NEAR_PLANE, FAR_PLANE);
+    float pixelsAtUnitDistance = projection[1][1] * size * 0.5f;
+    vector<unsigned char> reference(size * size * 4), pixels(size * size * 4);
+    bool passed = true;
+    unsigned int tested = 0;
+    for (size_t m = 0; m < scene.models.size(); m++) {
+        Model &model = scene.models[m];
+        if (model.lodErrors.size() < 2)
+            continue;
+        const SceneEntity *entity = nullptr;
+        for (const SceneEntity &candidate : scene.entities)
+            if (candidate.model == m) {
+                entity = &candidate;
+                break;
+            }
+        if (!entity)
+            continue;
+        SceneShader &shader = scene.shaders[entity->shader];
+        model.SetShaderTextureNamePrefix("material.");
+        const glm::mat4 &transform = entity->transform;
+        MeshBounds bounds = model.bounds.Transformed(transform);
+        float scale = std::sqrt(std::max(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+                                std::max(glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])),
+                                         glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])))));
+
+        for (unsigned int level = 1; level < model.lodErrors.size(); level++) {
+            // the distance where the level's projected error drops to Model::LOD_PIXEL_ERROR, the
+            // closest the scene ever draws it
+            float distance = pixelsAtUnitDistance * scale * model.lodErrors[level] / Model::LOD_PIXEL_ERROR + bounds.radius;
+            camera.Position = bounds.center + glm::normalize(glm::vec3(1.0f, 0.5f, 1.0f)) * distance;
+            camera.Front = glm::normalize(bounds.center - camera.Position);
+            glm::mat4 view = glm::lookAt(camera.Position, bounds.center, glm::vec3(0.0f, 1.0f, 0.0f));
+            frameUniforms.Update(buildFrameUniforms(projection, view, scene));
+
+            for (unsigned int pass = 0; pass < 2; pass++) {
+                glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                shader.program.use();
+                shader.program.setMat4(shader.model, transform);
+                shader.program.setInt(shader.pointLightIndex, std::max(entity->pointLight, 0));
+                model.Draw(shader.program, pass == 0 ? 0 : level);
+                glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pass == 0 ? reference.data() : pixels.data());
+            }
+
+            size_t covered = 0, different = 0;
+            for (size_t i = 0; i < pixels.size(); i += 4) {
+                if (!reference[i + 3] && !pixels[i + 3])
+                    continue;
+                covered++;
+                for (int channel = 0; channel < 4; channel++)
+                    if (std::abs((int)reference[i + channel] - (int)pixels[i + channel]) > LOD_TEST_TOLERANCE) {
+                        different++;
+                        break;
+                    }
+            }
+            // a level that put nothing on screen compared nothing
+            float share = (float)different / std::max<size_t>(covered, 1);
+            bool ok = covered > 0 && share <= LOD_TEST_MAX_DIFFERENT;
+            passed = passed && ok;
+            tested++;
+            std::cout << "LOD_TEST:: " << scene.modelNames[m] << " level " << level << " at " << distance << ": "
+                      << different << "/" << covered << " pixels differ (" << share * 100.0f << "%) "
+                      << (ok ? "ok" : "FAILED") << std::endl;
+        }
+    }
+    // without a single level there was nothing to compare, which says nothing about the levels
+    if (tested == 0) {
+        std::cout << "ERROR::LOD_TEST:: no model of the scene has a level of detail to test" << std::endl;
+        passed = false;
+    }
+    std::cout << "LOD_TEST:: " << tested << " levels tested, " << (passed ? "passed" : "FAILED") << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteFramebuffers(1, &framebuffer);
+    return passed;
+}
+
+// Headless check of the software occlusion culling (the same Hi-Z test the GPU path runs):
+// a wall in front of the camera against boxes behind, beside and in front of it, then the
+// scene's non-occluder entities over OCCLUSION_TEST_VIEWS random street views, with the
+// simplified occluders rasterized at Scene's resolution as the renderer does, and the full
+// occluders at four times that as the reference. Both pyramids are eroded (see DepthPyramid), so
+// the reference only hides what the full occluders cover completely. Fails when a box case is
+// wrong, when a single entity in view is hidden while the reference sees it, or when rendering
+// on one thread gives a depth buffer differing in any bit from the threaded one.
+bool testOcclusion(const Scene &scene)
+{
+    typedef std::chrono::steady_clock Clock;
+    const int OCCLUSION_TEST_VIEWS = 500;
+    const int width = Scene::SOFTWARE_OCCLUSION_WIDTH, height = Scene::SOFTWARE_OCCLUSION_HEIGHT;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    bool passed = true;
+
+    // a 4 x 4 wall 10 units ahead, facing the camera, and the same wall facing away
+    glm::mat4 viewProjection = projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const vector<glm::vec3> wall = {glm::vec3(-2.0f, -2.0f, -10.0f), glm::vec3(2.0f, -2.0f, -10.0f),
+                                    glm::vec3(2.0f, 2.0f, -10.0f), glm::vec3(-2.0f, 2.0f, -10.0f)};
+    struct BoxCase {
+        const char *name;
+        glm::vec3 min, max;
+        bool visible;
+        bool backFacing;
+    };
+    const BoxCase cases[] = {
+        {"behind the wall", glm::vec3(-0.5f, -0.5f, -20.5f), glm::vec3(0.5f, 0.5f, -19.5f), false, false},
+        {"in front of the wall", glm::vec3(-0.5f, -0.5f, -5.5f), glm::vec3(0.5f, 0.5f, -4.5f), true, false},
+        {"beside the wall", glm::vec3(6.5f, -0.5f, -20.5f), glm::vec3(7.5f, 0.5f, -19.5f), true, false},
+        {"partly behind the wall", glm::vec3(3.0f, -0.5f, -20.5f), glm::vec3(6.0f, 0.5f, -19.5f), true, false},
+        {"around the camera", glm::vec3(-1.0f), glm::vec3(1.0f), true, false},
+        {"behind a back facing wall", glm::vec3(-0.5f, -0.5f, -20.5f), glm::vec3(0.5f, 0.5f, -19.5f), true, true},
+    };
+    for (const BoxCase &box : cases) {
+        SoftwareOcclusion occlusion(1);
+        occlusion.Resize(width, height);
+        occlusion.AddOccluder(wall, box.backFacing ? vector<unsigned int>{0, 2, 1, 0, 3, 2} : vector<unsigned int>{0, 1, 2, 0, 2, 3},
+                              glm::mat4(1.0f));
+        occlusion.Render(viewProjection);
+        MeshBounds bounds;
+        bounds.min = box.min;
+        bounds.max = box.max;
+        bool ok = occlusion.IsVisible(bounds, viewProjection) == box.visible;
+        passed = passed && ok;
+        std::cout << "OCCLUSION_TEST:: box " << box.name << ": " << (ok ? "ok" : "FAILED") << std::endl;
+    }
+
+    // the scene's models, as imported for it
+    SoftwareOcclusion occlusion, singleThreaded(1), reference;
+    occlusion.Resize(width, height);
+    singleThreaded.Resize(width, height);
+    reference.Resize(4 * width, 4 * height);
+    vector<MeshBounds> modelBounds(scene.modelPaths.size());
+    vector<ModelData> occluders(scene.modelPaths.size());
+    for (size_t m = 0; m < scene.modelPaths.size(); m++) {
+        ModelData data;
+        if (!Model::LoadModelData(scene.modelPaths[m], data, true, true, scene.modelClustered[m] ? Scene::CLUSTER_TRIANGLES : 0)
+            || data.meshes.empty()) {
+            std::cout << "ERROR::OCCLUSION_TEST:: could not load " << scene.modelPaths[m] << std::endl;
+            return false;
+        }
+        modelBounds[m] = data.meshes[0].bounds;
+        for (const MeshData &mesh : data.meshes) {
+            modelBounds[m].min = glm::min(modelBounds[m].min, mesh.bounds.min);
+            modelBounds[m].max = glm::max(modelBounds[m].max, mesh.bounds.max);
+        }
+        if (scene.modelOccluder[m])
+            occluders[m] = std::move(data);
+    }
+    BoundsArray entityBounds;
+    vector<MeshBounds> boxes;
+    MeshBounds occluderBounds;
+    bool anyOccluder = false;
+    for (const SceneEntity &entity : scene.entities) {
+        MeshBounds bounds = modelBounds[entity.model].Transformed(entity.transform);
+        if (!scene.modelOccluder[entity.model]) {
+            boxes.push_back(bounds);
+            entityBounds.Add(bounds);
+            continue;
+        }
+        occluderBounds.min = anyOccluder ? glm::min(occluderBounds.min, bounds.min) : bounds.min;
+        occluderBounds.max = anyOccluder ? glm::max(occluderBounds.max, bounds.max) : bounds.max;
+        anyOccluder = true;
+        for (const MeshData &mesh : occluders[entity.model].meshes) {
+            vector<glm::vec3> positions;
+            for (const Vertex &vertex : mesh.vertices)
+                positions.push_back(vertex.Position);
+            reference.AddOccluder(positions, mesh.indices, entity.transform);
+            vector<unsigned int> indices;
+            positions.clear();
+            MeshSimplifier::SimplifyOccluder(mesh, Model::OCCLUDER_MAX_ERROR, positions, indices);
+            occlusion.AddOccluder(positions, indices, entity.transform);
+            singleThreaded.AddOccluder(positions, indices, entity.transform);
+        }
+    }
+    if (!anyOccluder) {
+        std::cout << "OCCLUSION_TEST:: the scene declares no occluder models" << std::endl;
+        std::cout << "OCCLUSION_TEST:: " << (passed ? "passed" : "FAILED") << std::endl;
+        return passed;
+    }
+
+    // views at the starting camera's height over the occluders, looking anywhere around
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    size_t inFrustum = 0, hidden = 0, referenceHidden = 0, falselyHidden = 0, differentViews = 0;
+    double renderMs = 0.0, singleThreadedMs = 0.0, testUs = 0.0;
+    vector<unsigned char> visible;
+    for (int view = 0; view < OCCLUSION_TEST_VIEWS; view++) {
+        glm::vec3 position(occluderBounds.min.x + (occluderBounds.max.x - occluderBounds.min.x) * unit(random), camera.Position.y,
+                           occluderBounds.min.z + (occluderBounds.max.z - occluderBounds.min.z) * unit(random));
+        float yaw = glm::radians(360.0f * unit(random));
+        glm::vec3 front(std::cos(yaw), -0.2f, std::sin(yaw));
+        viewProjection = projection * glm::lookAt(position, position + front, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        Clock::time_point start = Clock::now();
+        occlusion.Render(viewProjection);
+        renderMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        start = Clock::now();
+        singleThreaded.Render(viewProjection);
+        singleThreadedMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        differentViews += memcmp(occlusion.pyramid.Depth().data(), singleThreaded.pyramid.Depth().data(),
+                                 occlusion.pyramid.Depth().size() * sizeof(float)) != 0;
+        reference.Render(viewProjection);
+
+        inFrustum += entityBounds.Cull(Frustum(viewProjection), visible);
+        for (size_t i = 0; i < boxes.size(); i++) {
+            if (!visible[i])
+                continue;
+            start = Clock::now();
+            bool isVisible = occlusion.IsVisible(boxes[i], viewProjection);
+            testUs += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            bool referenceVisible = reference.IsVisible(boxes[i], viewProjection);
+            hidden += !isVisible;
+            referenceHidden += !referenceVisible;
+            falselyHidden += !isVisible && referenceVisible;
+        }
+    }
+    bool ok = falselyHidden == 0;
+    passed = passed && ok && differentViews == 0;
+    std::cout << "OCCLUSION_TEST:: " << OCCLUSION_TEST_VIEWS << " views, " << occlusion.indices.size() / 3 << " occluder triangles ("
+              << reference.indices.size() / 3 << " before simplification): "
+              << (double)inFrustum / OCCLUSION_TEST_VIEWS << " of " << boxes.size() << " entities in the frustum per view, "
+              << (double)hidden / OCCLUSION_TEST_VIEWS << " hidden at " << width << "x" << height << " ("
+              << (double)referenceHidden / OCCLUSION_TEST_VIEWS << " at " << 4 * width << "x" << 4 * height << "), "
+              << renderMs / OCCLUSION_TEST_VIEWS << " ms to rasterize (" << singleThreadedMs / OCCLUSION_TEST_VIEWS
+              << " on one thread), " << testUs / std::max<size_t>(inFrustum, 1) << " us per box" << std::endl;
+    std::cout << "OCCLUSION_TEST:: " << falselyHidden << " hidden but visible at the reference resolution "
+              << (ok ? "ok" : "FAILED") << std::endl;
+    std::cout << "OCCLUSION_TEST:: " << differentViews << " views rasterized differently on one thread "
+              << (differentViews == 0 ? "ok" : "FAILED") << std::endl;
+    std::cout << "OCCLUSION_TEST:: " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+// a point light of the scene file with the weights of its terms applied, for both shading paths
+PointLight shadedPointLight(const PointLight &light) {
+    PointLight shaded = light;
+    shaded.ambient = light.ambient * 0.3f;
+    shaded.diffuse = light.diffuse * 2.0f;
+    shaded.specular = light.specular * 0.5f;
+    return shaded;
+}
+
+FrameUniforms buildFrameUniforms(const glm::mat4 &projection, const glm::mat4 &view, const Scene &scene) {
+    FrameUniforms frame = FrameUniforms();
+    frame.projection = projection;
+    frame.view = view;
+    frame.viewPos = camera.Position;
+    frame.blinn = blinn;
+
+    frame.directional.direction = scene.directional.direction;
+    frame.directional.ambient = scene.directional.ambient;
+    frame.directional.diffuse = scene.directional.diffuse;
+    frame.directional.specular = scene.directional.specular;
+
+    // the spotlight follows the camera
+    frame.spotlight.position = camera.Position;
+    frame.spotlight.direction = camera.Front;
+    frame.spotlight.cutOff = scene.spotlight.cutOff;
+    frame.spotlight.outerCutOff = scene.spotlight.outerCutOff;
+    frame.spotlight.ambient = scene.spotlight.ambient;
+    frame.spotlight.diffuse = scene.spotlight.diffuse;
+    frame.spotlight.specular = scene.spotlight.specular;
+
+    for (size_t i = 0; i < scene.pointLights.size() && i < FRAME_POINT_LIGHTS; i++) {
+        const PointLight light = shadedPointLight(scene.pointLights[i]);
+        frame.pointLights[i].position = light.position;
+        frame.pointLights[i].ambient = light.ambient;
+        frame.pointLights[i].diffuse = light.diffuse;
+        frame.pointLights[i].specular = light.specular;
+    }
+    return frame;
+}
+
+// every point light of the scene and the camera's spotlight as DeferredShading draws them, with the
+// colors of the forward shaders
+void buildLightVolumes(const Scene &scene, vector<LightVolume> &volumes) {
+    volumes.clear();
+    const SpotLight &spotlight = scene.spotlight;
+    const glm::vec3 spotIntensity = spotlight.ambient + spotlight.diffuse + spotlight.specular;
+    if (spotIntensity != glm::vec3(0.0f)) {
+        LightVolume volume;
+        volume.sphere = glm::vec4(camera.Position, DeferredShading::LightRadius(spotIntensity));
+        volume.ambient = spotlight.ambient;
+        volume.diffuse = spotlight.diffuse;
+        volume.specular = spotlight.specular;
+        volume.cone = glm::vec4(camera.Front, spotlight.cutOff);
+        volume.outerCutOff = spotlight.outerCutOff;
+        volumes.push_back(volume);
+    }
+    for (const PointLight &sceneLight : scene.pointLights) {
+        const PointLight light = shadedPointLight(sceneLight);
+        LightVolume volume;
+        volume.sphere = glm::vec4(light.position, DeferredShading::LightRadius(light.ambient + light.diffuse + light.specular));
+        volume.ambient = light.ambient;
+        volume.diffuse = light.diffuse;
+        volume.specular = light.specular;
+        volumes.push_back(volume);
+    }
 }
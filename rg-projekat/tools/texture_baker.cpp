@@ -0,0 +1,163 @@
+// Offline texture baker: converts every image under a directory to a block compressed DDS
+// (<image>.dds, full mip chain) that TextureRegistry uploads with glCompressedTexImage2D.
+// Runs without a GPU or window, so assets can be baked in CI.
+//
+// usage: texture_baker [--bc7] [--force] [--bc5 image]... [directory]   (directory defaults to resources)
+//
+// --bc5 keeps only the red and green channel of an image, as its path appears in the output.
+// Meant for tangent space normal maps whose shader rebuilds z = sqrt(1 - x*x - y*y); no shader
+// here does yet, so by default normal maps are baked like any other image.
+
+#include <stb_image.h>
+
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/thread_pool.h>
+
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> images;
+
+static bool isImage(const std::string &path)
+{
+    std::string lower = path;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    for (const char *extension : {".jpg", ".jpeg", ".png", ".tga", ".bmp"})
+    {
+        size_t length = strlen(extension);
+        if (lower.size() > length && lower.compare(lower.size() - length, length, extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+static int collect(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    if (type == FTW_F && isImage(path))
+        images.push_back(path);
+    return 0;
+}
+
+static bool upToDate(const std::string &source, const std::string &baked)
+{
+    struct stat sourceStat, bakedStat;
+    return stat(source.c_str(), &sourceStat) == 0 && stat(baked.c_str(), &bakedStat) == 0
+           && bakedStat.st_mtime >= sourceStat.st_mtime;
+}
+
+struct BakeResult {
+    std::string message;
+    size_t sourceBytes = 0;
+    size_t bakedBytes = 0;
+};
+
+static BakeResult bake(const std::string &path, bool bc7, bool bc5, bool force)
+{
+    BakeResult result;
+    std::string output = path + ".dds";
+    if (!force && upToDate(path, output))
+    {
+        result.message = path + ": up to date";
+        return result;
+    }
+
+    int width, height, nrComponents;
+    unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+    if (!pixels)
+    {
+        result.message = path + ": failed to decode (" + stbi_failure_reason() + ")";
+        return result;
+    }
+
+    // the registry draws single color images as material constants, a baked copy would only be
+    // uploaded instead (and an old one is removed for the same reason)
+    float color[4];
+    if (UniformColor(pixels, width, height, nrComponents, color))
+    {
+        stbi_image_free(pixels);
+        std::remove(output.c_str());
+        result.message = path + ": single color, left to the material constant";
+        return result;
+    }
+
+    // images with real alpha need BC3/BC7, the ones named by --bc5 keep two channels only
+    bool hasAlpha = false;
+    if (nrComponents == 4 || nrComponents == 2)
+        for (int i = 0; i < width * height && !hasAlpha; i++)
+            hasAlpha = pixels[i * nrComponents + nrComponents - 1] != 255;
+    BlockFormat format = bc5 ? BlockFormat::BC5 : bc7 ? BlockFormat::BC7 : hasAlpha ? BlockFormat::BC3 : BlockFormat::BC1;
+
+    CompressedImage image = CompressImage(pixels, width, height, nrComponents, format);
+    stbi_image_free(pixels);
+
+    // what the uncompressed upload costs: RGBA8 (drivers pad RGB) plus a third for the mips
+    result.sourceBytes = (size_t)width * height * 4 * 4 / 3;
+    result.bakedBytes = image.totalBytes();
+    if (!WriteDDS(output, image))
+    {
+        result.message = output + ": failed to write";
+        return result;
+    }
+    result.message = path + ": " + BlockFormatName(format) + " " + std::to_string(width) + "x" + std::to_string(height)
+                     + ", " + std::to_string(image.levels.size()) + " levels, "
+                     + std::to_string(result.sourceBytes / 1024) + " KB -> " + std::to_string(result.bakedBytes / 1024) + " KB";
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    bool bc7 = false, force = false;
+    std::string root = "resources";
+    std::vector<std::string> bc5Images;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bc7") == 0)
+            bc7 = true;
+        else if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else if (strcmp(argv[i], "--bc5") == 0 && i + 1 < argc)
+            bc5Images.push_back(argv[++i]);
+        else
+            root = argv[i];
+    }
+
+    if (nftw(root.c_str(), collect, 16, FTW_PHYS) != 0)
+    {
+        std::cout << "ERROR::TEXTURE_BAKER:: cannot walk " << root << std::endl;
+        return 1;
+    }
+    std::sort(images.begin(), images.end());
+    for (const std::string &path : bc5Images)
+        if (!std::binary_search(images.begin(), images.end(), path))
+            std::cout << "ERROR::TEXTURE_BAKER:: --bc5 " << path << " is not an image under " << root << std::endl;
+
+    std::vector<std::future<BakeResult>> results;
+    {
+        ThreadPool pool;
+        for (const std::string &path : images)
+        {
+            bool bc5 = std::find(bc5Images.begin(), bc5Images.end(), path) != bc5Images.end();
+            results.push_back(pool.submit([path, bc7, bc5, force] { return bake(path, bc7, bc5, force); }));
+        }
+
+        size_t sourceTotal = 0, bakedTotal = 0;
+        for (std::future<BakeResult> &future : results)
+        {
+            BakeResult result = future.get();
+            sourceTotal += result.sourceBytes;
+            bakedTotal += result.bakedBytes;
+            std::cout << result.message << std::endl;
+        }
+        std::cout << images.size() << " images, " << sourceTotal / (1024 * 1024) << " MB uncompressed -> "
+                  << bakedTotal / (1024 * 1024) << " MB baked" << std::endl;
+    }
+    return 0;
+}